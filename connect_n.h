@@ -2,17 +2,20 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <bitset>
 #include <cmath>
 #include <cstdint>
-#include <ctime>
 #include <exception>
-#include <functional>
 #include <iostream>
 #include <limits>
 #include <optional>
 #include <vector>
 
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
 namespace ConnectN {
 struct Shape {
     int rows;
@@ -106,7 +109,10 @@ namespace ConnectN {
 
 template <size_t S_ROWS, size_t S_COLS>
 class Board {
-    const int connectN{4};
+   public:
+    static constexpr int connectN{4};
+
+   private:
     Shape m_shape{S_ROWS, S_COLS};
     std::bitset<S_ROWS * S_COLS> m_positivePieces;
     std::bitset<S_ROWS * S_COLS> m_negativePieces;
@@ -123,6 +129,15 @@ class Board {
     Shape shape() const { return m_shape; }
     const int N() const { return connectN; }
 
+    bool operator==(const Board& other) const {
+        return m_positivePieces == other.m_positivePieces &&
+               m_negativePieces == other.m_negativePieces;
+    }
+
+    const std::bitset<S_ROWS * S_COLS>& pieces(Tile tile) const {
+        return tile == Tile::Positive ? m_positivePieces : m_negativePieces;
+    }
+
     std::optional<Tile> operator[](Vec2i pos) const {
         if (!isValidPosition(pos)) {
             return {};
@@ -218,106 +233,133 @@ std::ostream& operator<<(std::ostream& os, Board<S_ROWS, S_COLS>& board) {
     return os;
 }
 
+// Every line of N cells on the board, precomputed once per board size. A
+// window is still "open" for a player as long as the enemy has no stone in it,
+// so the heuristic only has to AND and popcount each window against the two
+// piece sets.
 template <size_t S_ROWS, size_t S_COLS>
-std::pair<std::optional<long>, long> evaluate(Board<S_ROWS, S_COLS>& board) {
-    const int N{board.N()};
+class Windows {
+   public:
+    using Mask = std::bitset<S_ROWS * S_COLS>;
 
-    std::array<Vec2i, 4> directions{{{1, 0}, {0, 1}, {1, -1}, {1, 1}}};
-    Shape boardShape{board.shape()};
+    static const Windows& get() {
+        static const Windows table;
+        return table;
+    }
 
-    std::function<int(Vec2i, Vec2i, Tile)> check{
-        [&board, &boardShape, &N](Vec2i p, Vec2i d, Tile lastTile) -> int {
-            int count{0};
-            for (int i = 1; i < N; ++i) {
-                Vec2i current{p + d * i};
-                if (current.x < 0 || current.x >= boardShape.cols ||
-                    current.y < 0 || current.y >= boardShape.rows) {
-                    break;
-                }
+    const std::vector<Mask>& all() const { return m_masks; }
+    const std::vector<int>& throughCell(int index) const {
+        return m_byCell[index];
+    }
 
-                auto curOpt{board[current]};
-                if (!curOpt || curOpt.value() != lastTile) {
-                    break;
+   private:
+    Windows() {
+        const int N{Board<S_ROWS, S_COLS>::connectN};
+        const int rows{static_cast<int>(S_ROWS)};
+        const int cols{static_cast<int>(S_COLS)};
+        std::array<Vec2i, 4> directions{{{1, 0}, {0, 1}, {1, -1}, {1, 1}}};
+
+        for (int y{0}; y < rows; ++y) {
+            for (int x{0}; x < cols; ++x) {
+                for (auto d : directions) {
+                    Vec2i end{Vec2i{x, y} + d * (N - 1)};
+                    if (end.x < 0 || end.x >= cols || end.y < 0 ||
+                        end.y >= rows) {
+                        continue;
+                    }
+
+                    Mask mask;
+                    for (int i{0}; i < N; ++i) {
+                        Vec2i p{Vec2i{x, y} + d * i};
+                        mask.set(p.y * cols + p.x);
+                        m_byCell[p.y * cols + p.x].push_back(m_masks.size());
+                    }
+                    m_masks.push_back(mask);
                 }
-                count++;
             }
-            return count;
-        }};
+        }
+    }
 
-    long score{0};
-    for (int y{0}; y < boardShape.rows; ++y) {
-        for (int x{0}; x < boardShape.cols; ++x) {
-            auto tOpt{board[{x, y}]};
-            if (!tOpt || tOpt.value() == Tile::Empty) {
-                continue;
-            }
+    std::vector<Mask> m_masks;
+    std::array<std::vector<int>, S_ROWS * S_COLS> m_byCell;
+};
 
-            Vec2i p{x, y};
-            Tile lastTile{tOpt.value()};
-            for (auto d : directions) {
-                int count = 1;  // count the last placed token
-                count += check(p, d, lastTile);
-                if (count >= N) {
-                    return {static_cast<long>(lastTile),
-                            (lastTile == Tile::Positive
-                                 ? std::numeric_limits<long>::max()
-                                 : std::numeric_limits<long>::min())};
-                }
-                count += check(p, -d, lastTile);
-                if (count >= N) {
-                    return {static_cast<long>(lastTile),
-                            (lastTile == Tile::Positive
-                                 ? std::numeric_limits<long>::max()
-                                 : std::numeric_limits<long>::min())};
-                }
+// Score of an open window holding k stones of a single player. A window holding
+// N stones is a win and is never scored.
+constexpr std::array<long, 4> windowWeights{0, 1, 10, 100};
 
-                score += std::pow(10, count) * static_cast<long>(lastTile);
-            }
-        }
+// Wins score above anything the heuristic can reach. (cells left + 1) / 2 is
+// how many moves the winner would still have had, so faster wins score higher.
+constexpr long winScore{1'000'000};
+
+template <size_t S_ROWS, size_t S_COLS>
+long emptyCells(const Board<S_ROWS, S_COLS>& board) {
+    return S_ROWS * S_COLS -
+           (board.pieces(Tile::Positive) | board.pieces(Tile::Negative))
+               .count();
+}
+
+template <size_t S_ROWS, size_t S_COLS>
+long winScoreFor(const Board<S_ROWS, S_COLS>& board, Tile winner) {
+    return (winScore + (emptyCells(board) + 1) / 2) *
+           static_cast<long>(winner);
+}
+
+template <size_t S_ROWS, size_t S_COLS>
+std::pair<std::optional<long>, long> evaluateWindow(
+    Board<S_ROWS, S_COLS>& board,
+    const typename Windows<S_ROWS, S_COLS>::Mask& window, long& score) {
+    const size_t N{Board<S_ROWS, S_COLS>::connectN};
+
+    size_t positive{(board.pieces(Tile::Positive) & window).count()};
+    size_t negative{(board.pieces(Tile::Negative) & window).count()};
+    if (positive == N) {
+        return {static_cast<long>(Tile::Positive),
+                winScoreFor(board, Tile::Positive)};
     }
-    // Draw Check
-    bool isDraw{true};
-    for (int i{0}; i < boardShape.cols; ++i) {
-        if (board[{i, 0}] == Tile::Empty) {
-            isDraw = false;
-            break;
+    if (negative == N) {
+        return {static_cast<long>(Tile::Negative),
+                winScoreFor(board, Tile::Negative)};
+    }
+
+    if (negative == 0) {
+        score += windowWeights[positive];
+    } else if (positive == 0) {
+        score -= windowWeights[negative];
+    }
+    return {{}, 0};
+}
+
+template <size_t S_ROWS, size_t S_COLS>
+bool isBoardFull(Board<S_ROWS, S_COLS>& board) {
+    return emptyCells(board) == 0;
+}
+
+template <size_t S_ROWS, size_t S_COLS>
+std::pair<std::optional<long>, long> evaluate(Board<S_ROWS, S_COLS>& board) {
+    const auto& windows{Windows<S_ROWS, S_COLS>::get()};
+
+    long score{0};
+    for (const auto& window : windows.all()) {
+        auto res{evaluateWindow(board, window, score)};
+        if (res.first) {
+            return res;
         }
     }
 
-    if (isDraw) {
+    if (isBoardFull(board)) {
         return {0, 0};
     }
 
     return {{}, score};
 }
 
+// Same as above, but only looks at the windows passing through the last played
+// position. Enough to detect the win that move may have created.
 template <size_t S_ROWS, size_t S_COLS>
 std::pair<std::optional<long>, long> evaluate(Board<S_ROWS, S_COLS>& board,
                                               Vec2i lastPosition) {
-    const int N{board.N()};
-
-    std::array<Vec2i, 4> directions{{{1, 0}, {0, 1}, {1, -1}, {1, 1}}};
-    Shape boardShape{board.shape()};
-
-    std::function<int(Vec2i, Tile)> check{
-        [&board, &boardShape, &N, &lastPosition](Vec2i d,
-                                                 Tile lastTile) -> int {
-            int count{0};
-            for (int i = 1; i < N; ++i) {
-                Vec2i current{lastPosition + d * i};
-                if (current.x < 0 || current.x >= boardShape.cols ||
-                    current.y < 0 || current.y >= boardShape.rows) {
-                    break;
-                }
-
-                auto curOpt{board[current]};
-                if (!curOpt || curOpt.value() != lastTile) {
-                    break;
-                }
-                count++;
-            }
-            return count;
-        }};
+    const auto& windows{Windows<S_ROWS, S_COLS>::get()};
 
     auto tOpt{board[lastPosition]};
     if (!tOpt || tOpt.value() == Tile::Empty) {
@@ -325,42 +367,44 @@ std::pair<std::optional<long>, long> evaluate(Board<S_ROWS, S_COLS>& board,
     }
 
     long score{0};
-    Tile lastTile{tOpt.value()};
-    for (auto d : directions) {
-        int count = 1;  // count the last placed token
-        count += check(d, lastTile);
-        if (count >= N) {
-            return {static_cast<long>(lastTile),
-                    (lastTile == Tile::Positive
-                         ? std::numeric_limits<long>::max()
-                         : std::numeric_limits<long>::min())};
-        }
-        count += check(-d, lastTile);
-        if (count >= N) {
-            return {static_cast<long>(lastTile),
-                    (lastTile == Tile::Positive
-                         ? std::numeric_limits<long>::max()
-                         : std::numeric_limits<long>::min())};
-        }
-
-        score += std::pow(10, count) * static_cast<long>(lastTile);
-    }
-    // Draw Check
-    bool isDraw{true};
-    for (int i{0}; i < boardShape.cols; ++i) {
-        if (board[{i, 0}] == Tile::Empty) {
-            isDraw = false;
-            break;
+    for (int w : windows.throughCell(lastPosition.y * board.shape().cols +
+                                     lastPosition.x)) {
+        auto res{evaluateWindow(board, windows.all()[w], score)};
+        if (res.first) {
+            return res;
         }
     }
 
-    if (isDraw) {
+    if (isBoardFull(board)) {
         return {0, 0};
     }
 
     return {{}, score};
 }
 
+// Whether playing the move wins, blocks an enemy window that is one stone
+// short, or leaves one of our own windows one stone short. Checked before the
+// move is placed, using only the windows through its cell.
+template <size_t S_ROWS, size_t S_COLS>
+bool isTacticalMove(const Board<S_ROWS, S_COLS>& board, Move move) {
+    const size_t N{Board<S_ROWS, S_COLS>::connectN};
+    const auto& windows{Windows<S_ROWS, S_COLS>::get()};
+    const auto& own{board.pieces(move.tile)};
+    const auto& enemy{board.pieces(getEnemyTile(move.tile))};
+
+    for (int w : windows.throughCell(move.pos.y * board.shape().cols +
+                                     move.pos.x)) {
+        const auto& window{windows.all()[w]};
+        size_t ownCount{(own & window).count()};
+        size_t enemyCount{(enemy & window).count()};
+        if ((enemyCount == 0 && ownCount + 2 >= N) ||
+            (ownCount == 0 && enemyCount + 1 == N)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 template <size_t S_ROWS, size_t S_COLS>
 std::vector<Vec2i> generateValidPositions(const Board<S_ROWS, S_COLS>& board) {
     Shape boardShape{board.shape()};
@@ -377,7 +421,7 @@ std::vector<Vec2i> generateValidPositions(const Board<S_ROWS, S_COLS>& board) {
                 break;
             }
         }
-        if (res.back().x != x) {
+        if (res.empty() || res.back().x != x) {
             res.push_back({x, boardShape.rows - 1});
         }
     }
@@ -385,6 +429,549 @@ std::vector<Vec2i> generateValidPositions(const Board<S_ROWS, S_COLS>& board) {
     return res;
 }
 
+// Hash of the stones on the board. Whose turn it is follows from the stone
+// count, so the two piece sets identify a position completely.
+template <size_t S_ROWS, size_t S_COLS>
+uint64_t positionKey(const Board<S_ROWS, S_COLS>& board) {
+    std::hash<std::bitset<S_ROWS * S_COLS>> hash;
+    uint64_t key{hash(board.pieces(Tile::Positive))};
+    return key ^ (hash(board.pieces(Tile::Negative)) + 0x9e3779b97f4a7c15ULL +
+                  (key << 6) + (key >> 2));
+}
+
+// xoshiro256** (Blackman and Vigna). Small, fast and statistically sound for
+// playouts. Every searcher owns its own, so threads share no hidden state and
+// each one's stream depends only on its seed.
+class Random {
+   public:
+    using result_type = uint64_t;
+
+    explicit Random(uint64_t t_seed = 0) { seed(t_seed); }
+
+    // Expands the seed with splitmix64, as recommended for xoshiro.
+    void seed(uint64_t t_seed) {
+        for (uint64_t& word : m_state) {
+            t_seed += 0x9e3779b97f4a7c15ULL;
+            uint64_t z{t_seed};
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t operator()() {
+        uint64_t result{std::rotl(m_state[1] * 5, 7) * 9};
+        uint64_t t{m_state[1] << 17};
+
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = std::rotl(m_state[3], 45);
+
+        return result;
+    }
+
+    static constexpr uint64_t min() { return 0; }
+    static constexpr uint64_t max() { return ~0ULL; }
+
+    // Uniform in [0, bound), without a division in the common case (Lemire).
+    uint32_t below(uint32_t bound) {
+        uint64_t product{((*this)() >> 32) * bound};
+        if (static_cast<uint32_t>(product) < bound) {
+            uint32_t threshold{static_cast<uint32_t>(-bound) % bound};
+            while (static_cast<uint32_t>(product) < threshold) {
+                product = ((*this)() >> 32) * bound;
+            }
+        }
+        return product >> 32;
+    }
+
+    // Index of a uniformly chosen set bit of `mask`, which must not be 0.
+    int randomSetBit(uint64_t mask) {
+        uint32_t skip{below(std::popcount(mask))};
+#ifdef __BMI2__
+        return std::countr_zero(_pdep_u64(1ULL << skip, mask));
+#else
+        for (; skip > 0; --skip) {
+            mask &= mask - 1;
+        }
+        return std::countr_zero(mask);
+#endif
+    }
+
+   private:
+    std::array<uint64_t, 4> m_state;
+};
+
+// A board packed into one word per player, column after column with a spare
+// bit on top of each column (Pons' layout): cell (x, y) is bit
+// x * (S_ROWS + 1) + (S_ROWS - 1 - y), so a column fills from its low bit up.
+// Shifting by 1, S_ROWS, S_ROWS + 1 and S_ROWS + 2 steps to the next cell
+// vertically, diagonally and horizontally, and the spare bits stop lines from
+// wrapping into the next column.
+template <size_t S_ROWS, size_t S_COLS>
+struct BitBoard {
+    static_assert((S_ROWS + 1) * S_COLS <= 64,
+                  "BitBoard needs (rows + 1) * cols <= 64");
+
+    static constexpr int height{S_ROWS + 1};
+
+    static constexpr uint64_t bottomMask() {
+        uint64_t mask{0};
+        for (size_t x{0}; x < S_COLS; ++x) {
+            mask |= 1ULL << (x * height);
+        }
+        return mask;
+    }
+    static constexpr uint64_t boardMask() {
+        return bottomMask() * ((1ULL << S_ROWS) - 1);
+    }
+    static constexpr uint64_t columnMask(int column) {
+        return ((1ULL << S_ROWS) - 1) << (column * height);
+    }
+
+    static constexpr int side(Tile tile) {
+        return tile == Tile::Positive ? 0 : 1;
+    }
+
+    // Indexed by side().
+    std::array<uint64_t, 2> stones;
+    uint64_t mask;
+
+    BitBoard() : stones{0, 0}, mask(0) {}
+
+    explicit BitBoard(const Board<S_ROWS, S_COLS>& board) : BitBoard() {
+        for (size_t y{0}; y < S_ROWS; ++y) {
+            for (size_t x{0}; x < S_COLS; ++x) {
+                uint64_t bit{1ULL << (x * height + (S_ROWS - 1 - y))};
+                if (board.pieces(Tile::Positive)[y * S_COLS + x]) {
+                    stones[0] |= bit;
+                } else if (board.pieces(Tile::Negative)[y * S_COLS + x]) {
+                    stones[1] |= bit;
+                }
+            }
+        }
+        mask = stones[0] | stones[1];
+    }
+
+    bool operator==(const BitBoard& other) const {
+        return stones == other.stones;
+    }
+
+    // Unique per position: every column of the mask is a run of low bits, so
+    // adding a subset of it never carries into the next column.
+    uint64_t key() const { return stones[0] + mask; }
+
+    // The cell the next stone of every column that isn't full would land on.
+    uint64_t playable() const { return (mask + bottomMask()) & boardMask(); }
+
+    bool canPlay(int column) const {
+        return (playable() & columnMask(column)) != 0;
+    }
+
+    // Row, counted from the top like Board does, of the next stone in a column.
+    int landingRow(int column) const {
+        return S_ROWS - 1 -
+               std::popcount(mask & columnMask(column));
+    }
+
+    // `move` is the single bit of a cell from playable().
+    void playBit(uint64_t move, Tile tile) {
+        stones[side(tile)] |= move;
+        mask |= move;
+    }
+
+    void play(int column, Tile tile) {
+        playBit(playable() & columnMask(column), tile);
+    }
+
+    // The cells that start N in a line of `pieces`, in any direction.
+    // Constant time: for every direction, keep the stones with a neighbour k
+    // steps further along, doubling k. Also takes GCC vectors of words.
+    template <typename Word>
+    static Word lineStarts(Word pieces) {
+        constexpr int N{Board<S_ROWS, S_COLS>::connectN};
+        Word res{};
+        for (int shift : {1, height - 1, height, height + 1}) {
+            Word run{pieces};
+            int length{1};
+            while (length * 2 <= N) {
+                run &= run >> (shift * length);
+                length *= 2;
+            }
+            if (length < N) {
+                run &= run >> (shift * (N - length));
+            }
+            res |= run;
+        }
+        return res;
+    }
+
+    static bool hasWon(uint64_t pieces) { return lineStarts(pieces) != 0; }
+
+    // The empty cells, playable or not, that would complete N in a line of
+    // `pieces`. For every direction and every place of the missing stone in
+    // the line, AND the other N - 1 stones shifted onto it.
+    template <typename Word>
+    static Word winningCells(Word pieces, Word mask) {
+        constexpr int N{Board<S_ROWS, S_COLS>::connectN};
+        // Pieces `offset` steps along the direction, moved onto their cell.
+        std::array<Word, 2 * N - 1> along;
+        Word res{};
+        for (int shift : {1, height - 1, height, height + 1}) {
+            for (int offset{1 - N}; offset < N; ++offset) {
+                along[offset + N - 1] = offset >= 0
+                                            ? pieces >> (shift * offset)
+                                            : pieces << (-shift * offset);
+            }
+            // Vertically the stones can only be below the cell.
+            const int lastFirst{shift == 1 ? 1 - N : 0};
+            for (int first{1 - N}; first <= lastFirst; ++first) {
+                Word run{~Word{}};
+                for (int offset{first}; offset < first + N; ++offset) {
+                    if (offset != 0) {
+                        run &= along[offset + N - 1];
+                    }
+                }
+                res |= run;
+            }
+        }
+        return res & (boardMask() ^ mask);
+    }
+};
+
+// What a playout does instead of picking uniformly among the legal moves.
+// Each rule only applies when the ones before it don't.
+struct RolloutPolicy {
+    // Play a move that wins on the spot.
+    bool takeWins{false};
+    // Play a move that stops the opponent winning on the spot.
+    bool blockLosses{false};
+    // Don't play right below a cell the opponent would win on, unless there is
+    // nothing else.
+    bool avoidGifts{false};
+
+    static constexpr RolloutPolicy uniform() { return {}; }
+    static constexpr RolloutPolicy heavy() { return {true, true, true}; }
+};
+
+// Plays random moves from `board`, `turn` to move, until the game ends,
+// following `policy`. +1 if Positive wins, -1 if Negative wins, 0 for a draw.
+// Only the player who just moved can have won, so that is all that is checked,
+// and not even that when wins are taken as soon as they are playable. The
+// final position goes to `end` if given.
+template <size_t S_ROWS, size_t S_COLS>
+long randomRollout(BitBoard<S_ROWS, S_COLS> board, Tile turn, Random& rng,
+                   RolloutPolicy policy = RolloutPolicy::uniform(),
+                   BitBoard<S_ROWS, S_COLS>* end = nullptr) {
+    using Bits = BitBoard<S_ROWS, S_COLS>;
+    const bool threats{policy.blockLosses || policy.avoidGifts};
+    while (true) {
+        uint64_t moves{board.playable()};
+        if (!moves) {
+            if (end) {
+                *end = board;
+            }
+            return 0;
+        }
+
+        uint64_t mine{board.stones[Bits::side(turn)]};
+        uint64_t wins{policy.takeWins
+                          ? moves & Bits::winningCells(mine, board.mask)
+                          : 0};
+        if (wins) {
+            if (end) {
+                *end = board;
+                end->playBit(wins & (0 - wins), turn);
+            }
+            return static_cast<long>(turn);
+        }
+        if (threats) {
+            uint64_t theirs{board.stones[Bits::side(getEnemyTile(turn))]};
+            uint64_t losing{Bits::winningCells(theirs, board.mask)};
+            uint64_t blocks{moves & losing};
+            uint64_t safe{moves & ~(losing >> 1)};
+            if (policy.blockLosses && blocks) {
+                moves = blocks;
+            } else if (policy.avoidGifts && safe) {
+                moves = safe;
+            }
+        }
+
+        board.playBit(1ULL << rng.randomSetBit(moves), turn);
+        if (!policy.takeWins &&
+            Bits::hasWon(board.stones[Bits::side(turn)])) {
+            if (end) {
+                *end = board;
+            }
+            return static_cast<long>(turn);
+        }
+        turn = getEnemyTile(turn);
+    }
+}
+
+// Shallow alpha-beta on the bitboard that only looks for forced results:
+// +1 if `turn` can force a win within `depth` plies, -1 if the opponent can,
+// 0 if neither (a draw included). Moves that lose on the spot are never
+// searched: with an opponent's win playable the only move is to block it, two
+// of them lose, and playing right below one hands it over.
+template <size_t S_ROWS, size_t S_COLS>
+int probeOutcome(const BitBoard<S_ROWS, S_COLS>& board, Tile turn, int depth,
+                 int alpha = -1, int beta = 1) {
+    using Bits = BitBoard<S_ROWS, S_COLS>;
+    uint64_t moves{board.playable()};
+    uint64_t mine{board.stones[Bits::side(turn)]};
+    if (depth <= 0 || !moves) {
+        return 0;
+    }
+    if (moves & Bits::winningCells(mine, board.mask)) {
+        return 1;
+    }
+    if (depth == 1) {
+        return 0;
+    }
+
+    uint64_t theirs{board.stones[Bits::side(getEnemyTile(turn))]};
+    uint64_t losing{Bits::winningCells(theirs, board.mask)};
+    uint64_t blocks{moves & losing};
+    if (blocks & (blocks - 1)) {
+        return -1;
+    }
+    moves = blocks ? blocks : moves & ~(losing >> 1);
+
+    // Centre columns first, they are the most likely to cut off.
+    int best{-1};
+    for (int i{0}; i < static_cast<int>(S_COLS) && moves; ++i) {
+        int column{static_cast<int>(S_COLS) / 2 +
+                   (i % 2 ? -(i + 1) / 2 : i / 2)};
+        uint64_t move{moves & Bits::columnMask(column)};
+        if (!move) {
+            continue;
+        }
+        moves ^= move;
+
+        Bits next{board};
+        next.playBit(move, turn);
+        int value{-probeOutcome(next, getEnemyTile(turn), depth - 1, -beta,
+                                -alpha)};
+        best = std::max(best, value);
+        alpha = std::max(alpha, value);
+        if (alpha >= beta) {
+            break;
+        }
+    }
+    return best;
+}
+
+struct RolloutCounts {
+    long positive{0};
+    long negative{0};
+    long draws{0};
+
+    // Playout results added up, +1 per Positive win and -1 per Negative win.
+    long sum() const { return positive - negative; }
+};
+
+// Random playouts run several games at a time, one per lane of a SIMD
+// register: 8 with AVX-512, 4 with AVX2 and 2 with SSE2, through GCC vector
+// extensions. Every lane has its own xoshiro256** stream. A lane whose game
+// ends records the result and starts over from the same position until it has
+// played its share. Compilers without vector extensions get a loop over
+// randomRollout().
+template <size_t S_ROWS, size_t S_COLS>
+class RolloutLanes {
+   public:
+#if defined(__AVX512F__)
+    static constexpr int width{8};
+#elif defined(__AVX2__)
+    static constexpr int width{4};
+#else
+    static constexpr int width{2};
+#endif
+
+    explicit RolloutLanes(uint64_t t_seed = 0) {
+        Random seeder(t_seed);
+        seed(seeder);
+    }
+
+    // Draws the lanes' states from `seeder`.
+    void seed(Random& seeder) {
+#ifdef __GNUC__
+        for (Word& word : m_state) {
+            for (int lane{0}; lane < width; ++lane) {
+                word[lane] = seeder();
+            }
+        }
+#else
+        m_rng.seed(seeder());
+#endif
+    }
+
+    // Plays `games` random games from `board`, `turn` to move, following
+    // `policy` as randomRollout() does. The game must not be over yet.
+    RolloutCounts run(const BitBoard<S_ROWS, S_COLS>& board, Tile turn,
+                      int games,
+                      RolloutPolicy policy = RolloutPolicy::uniform()) {
+        RolloutCounts res;
+#ifdef __GNUC__
+        using Bits = BitBoard<S_ROWS, S_COLS>;
+        // A random column index per lane and move, rejected when it is past
+        // the last column or the policy rules the column out.
+        constexpr int columnBits{std::bit_width(S_COLS - 1)};
+        constexpr int drawsPerWord{64 / columnBits};
+
+        const Word startMover{Word{} + board.stones[Bits::side(turn)]};
+        const Word startOther{Word{} +
+                              board.stones[Bits::side(getEnemyTile(turn))]};
+        const Word startMask{Word{} + board.mask};
+        const Word startPositive{Word{} -
+                                 static_cast<uint64_t>(turn == Tile::Positive)};
+
+        Word mover{startMover};
+        Word other{startOther};
+        Word mask{startMask};
+        // All ones in the lanes where Positive is to move.
+        Word positiveToMove{startPositive};
+        Word remaining;
+        for (int lane{0}; lane < width; ++lane) {
+            remaining[lane] = games / width + (lane < games % width);
+        }
+        Word positiveWins{};
+        Word negativeWins{};
+        Word draws{};
+
+        Word random{};
+        int drawsLeft{0};
+        while (any(remaining)) {
+            if (drawsLeft == 0) {
+                random = next();
+                drawsLeft = drawsPerWord;
+            }
+            Word column{random & ((1ULL << columnBits) - 1)};
+            random >>= columnBits;
+            --drawsLeft;
+
+            Word active{(Word)(remaining != 0)};
+            Word playable{(mask + Bits::bottomMask()) & Bits::boardMask()};
+            // Lanes where the player to move wins right now.
+            Word winning{};
+            // Moves that block a win of the opponent, one of which has to be
+            // played.
+            Word blocks{};
+            Word candidates{playable};
+            if (policy.takeWins) {
+                Word wins{playable & Bits::winningCells(mover, mask)};
+                winning = (Word)(wins != 0) & active;
+            }
+            if (policy.blockLosses || policy.avoidGifts) {
+                Word losing{Bits::winningCells(other, mask)};
+                if (policy.blockLosses) {
+                    blocks = playable & losing;
+                }
+                if (policy.avoidGifts) {
+                    Word safe{playable & ~(losing >> 1)};
+                    Word anySafe{(Word)(safe != 0)};
+                    candidates = (safe & anySafe) | (playable & ~anySafe);
+                }
+            }
+
+            Word live{active & ~winning};
+            Word valid{(Word)(column < S_COLS) & live};
+            Word drawn{Bits::columnMask(0)
+                       << ((column & valid) * Bits::height)};
+            // A single block is played at once, one of several only when the
+            // column drawn is one of them, so each is as likely.
+            Word anyBlock{(Word)(blocks != 0)};
+            Word oneBlock{(Word)((blocks & (blocks - 1)) == 0)};
+            Word move{(blocks & live & oneBlock) |
+                      (blocks & valid & ~oneBlock & drawn) |
+                      (candidates & valid & ~anyBlock & drawn)};
+            Word moved{(Word)(move != 0)};
+
+            mover |= move;
+            mask |= move;
+
+            // Lanes that did not move still hold an unfinished game, and with
+            // wins taken as soon as they show up no move can win.
+            Word won{winning};
+            if (!policy.takeWins) {
+                won = (Word)(Bits::lineStarts(mover) != 0);
+            }
+            Word open{(mask + Bits::bottomMask()) & Bits::boardMask()};
+            Word full{(Word)(open == 0)};
+            Word finished{won | full};
+            positiveWins -= won & positiveToMove;
+            negativeWins -= won & ~positiveToMove;
+            draws -= full & ~won;
+
+            Word pass{(mover ^ other) & moved & ~finished};
+            mover ^= pass;
+            other ^= pass;
+            positiveToMove ^= moved & ~finished;
+
+            remaining += finished;
+            mover = (startMover & finished) | (mover & ~finished);
+            other = (startOther & finished) | (other & ~finished);
+            mask = (startMask & finished) | (mask & ~finished);
+            positiveToMove = (startPositive & finished) |
+                             (positiveToMove & ~finished);
+        }
+
+        for (int lane{0}; lane < width; ++lane) {
+            res.positive += positiveWins[lane];
+            res.negative += negativeWins[lane];
+            res.draws += draws[lane];
+        }
+#else
+        for (int i{0}; i < games; ++i) {
+            long result{randomRollout(board, turn, m_rng, policy)};
+            res.positive += result > 0;
+            res.negative += result < 0;
+            res.draws += result == 0;
+        }
+#endif
+        return res;
+    }
+
+   private:
+#ifdef __GNUC__
+    using Word =
+        uint64_t __attribute__((vector_size(width * sizeof(uint64_t))));
+
+    static bool any(Word word) {
+        uint64_t res{0};
+        for (int lane{0}; lane < width; ++lane) {
+            res |= word[lane];
+        }
+        return res != 0;
+    }
+
+    // xoshiro256** on every lane, multiplying through shifts since there is
+    // no 64-bit vector multiply before AVX-512.
+    Word next() {
+        Word x{(m_state[1] << 2) + m_state[1]};
+        x = (x << 7) | (x >> 57);
+        Word result{(x << 3) + x};
+        Word t{m_state[1] << 17};
+
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = (m_state[3] << 45) | (m_state[3] >> 19);
+
+        return result;
+    }
+
+    std::array<Word, 4> m_state;
+#else
+    Random m_rng;
+#endif
+};
+
 template <size_t S_ROWS, size_t S_COLS>
 class Player {
    public:
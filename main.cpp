@@ -1,4 +1,12 @@
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <thread>
 
 #include "connect_n.h"
 
@@ -34,6 +42,42 @@ class HumanPlayer : public Player<S_ROWS, S_COLS> {
     Tile m_tile;
 };
 
+// Scores are always from the Positive player's point of view, so a bound means
+// the same thing at maximising and minimising nodes.
+enum class Bound : int8_t { Exact, Lower, Upper };
+
+class TranspositionTable {
+   public:
+    struct Entry {
+        uint64_t key;
+        long score;
+        int8_t depth;
+        Bound bound;
+        int8_t column;  // Best column found in this position, -1 if none
+    };
+
+    explicit TranspositionTable(size_t t_size)
+        : m_entries(t_size, Entry{0, 0, -1, Bound::Exact, -1}) {}
+
+    const Entry* probe(uint64_t key) const {
+        const Entry& entry{m_entries[key % m_entries.size()]};
+        return (entry.depth >= 0 && entry.key == key) ? &entry : nullptr;
+    }
+
+    void store(uint64_t key, long score, int depth, Bound bound, int column) {
+        Entry& entry{m_entries[key % m_entries.size()]};
+        // Keep the deeper result when the same position is stored twice.
+        if (entry.key == key && entry.depth > depth) {
+            return;
+        }
+        entry = {key, score, static_cast<int8_t>(depth), bound,
+                 static_cast<int8_t>(column)};
+    }
+
+   private:
+    std::vector<Entry> m_entries;
+};
+
 template <size_t S_ROWS, size_t S_COLS>
 class MinimaxPlayer : public Player<S_ROWS, S_COLS> {
    public:
@@ -42,14 +86,24 @@ class MinimaxPlayer : public Player<S_ROWS, S_COLS> {
         : m_depth(t_depth),
           m_name(t_name),
           m_tile(t_tile),
-          m_enemyTile(t_enemyTile) {}
+          m_enemyTile(t_enemyTile),
+          m_table(1 << 20),
+          m_history{},
+          m_reductions(defaultReductions(t_depth)) {}
 
     std::string_view getFriendlyName() override { return m_name; }
     Tile getPlayerTile() override { return m_tile; }
 
+    // m_reductions[depth][i] is how many plies less the i-th move (in search
+    // order) of a node at that remaining depth is searched with. An empty
+    // table turns late move reductions off.
+    void setReductionTable(std::vector<std::vector<int>> t_reductions) {
+        m_reductions = std::move(t_reductions);
+    }
+
     std::pair<long, Move> alphabeta(Board<S_ROWS, S_COLS>& board, long alpha,
                                     long beta, long depth, bool isEnemy,
-                                    Move& lastMove) {
+                                    Move& lastMove, int ply = 0) {
         auto [isTerminal, score]{evaluate(board)};
         if (depth == 0 || isTerminal) {
             return {score, {}};
@@ -61,317 +115,1715 @@ class MinimaxPlayer : public Player<S_ROWS, S_COLS> {
                               ? (!isEnemy ? true : false)
                               : (!isEnemy ? false : true)};
 
-        std::vector<Vec2i> positions;
-        positions.reserve(board.shape().cols);
-        positions = generateValidPositions(board);
-
-        Move resultMove{positions[0], currentTile};
+        // The best the side to move can still hope for is winning with this
+        // very stone. If even that can't improve on what the other side is
+        // already guaranteed, there is nothing to search.
+        long bestPossible{winScore + emptyCells(board) / 2};
         if (isMaximising) {
-            // Is a maximising player
-            long maxValue = std::numeric_limits<long>::min();
+            beta = std::min(beta, bestPossible);
+            if (alpha >= beta) {
+                return {beta, {}};
+            }
+        } else {
+            alpha = std::max(alpha, -bestPossible);
+            if (alpha >= beta) {
+                return {alpha, {}};
+            }
+        }
+
+        const long alphaOrig{alpha};
+        const long betaOrig{beta};
+
+        uint64_t key{positionKey(board)};
+        int hashColumn{-1};
+        if (auto entry{m_table.probe(key)}) {
+            hashColumn = entry->column;
+            // The root always has to come back with a move.
+            if (ply > 0 && entry->depth >= depth) {
+                if (entry->bound == Bound::Exact) {
+                    return {entry->score, {}};
+                } else if (entry->bound == Bound::Lower) {
+                    alpha = std::max(alpha, entry->score);
+                } else {
+                    beta = std::min(beta, entry->score);
+                }
+                if (beta <= alpha) {
+                    return {entry->score, {}};
+                }
+            }
+        }
+
+        std::vector<Vec2i> positions{orderPositions(board, hashColumn)};
+
+        // Enhanced transposition cutoff: a child that the table already
+        // proves good enough for a cutoff makes searching the others
+        // pointless, so look them all up before recursing into any.
+        if (ply > 0 && depth > 1) {
             for (Vec2i& p : positions) {
                 Move m{p, currentTile};
                 board << m;
-
-                std::pair<long, Move> res{
-                    alphabeta(board, alpha, beta, depth - 1, !isEnemy, m)};
+                auto entry{m_table.probe(positionKey(board))};
                 board >> m;
 
-                if (res.first > maxValue) {
-                    maxValue = res.first;
-                    resultMove = m;
+                if (!entry || entry->depth < depth - 1) {
+                    continue;
                 }
-                alpha = std::max(alpha, res.first);
-                if (beta <= alpha) {
-                    break;
+                if (isMaximising && entry->bound != Bound::Upper &&
+                    entry->score >= beta) {
+                    return {entry->score, m};
+                }
+                if (!isMaximising && entry->bound != Bound::Lower &&
+                    entry->score <= alpha) {
+                    return {entry->score, m};
                 }
             }
-            return {maxValue, resultMove};
-        } else {
-            // Is a minimising player
-            long minValue = std::numeric_limits<long>::max();
-            for (auto& p : positions) {
-                Move m{p, currentTile};
-                board << m;
+        }
 
-                std::pair<long, Move> res{
-                    alphabeta(board, alpha, beta, depth - 1, !isEnemy, m)};
-                board >> m;
+        Move resultMove{positions[0], currentTile};
+        long bestValue{isMaximising ? std::numeric_limits<long>::min()
+                                    : std::numeric_limits<long>::max()};
+        for (int i{0}; i < static_cast<int>(positions.size()); ++i) {
+            Move m{positions[i], currentTile};
+            // Moves late in the ordering are rarely best, so quiet ones get a
+            // shallower look first and are only searched fully if they turn
+            // out to improve on the bound.
+            int reduction{ply > 0 ? reductionFor(depth, i) : 0};
+            if (reduction > 0 && isTacticalMove(board, m)) {
+                reduction = 0;
+            }
+            board << m;
+
+            std::pair<long, Move> res{alphabeta(board, alpha, beta,
+                                                depth - 1 - reduction,
+                                                !isEnemy, m, ply + 1)};
+            if (reduction > 0 &&
+                (isMaximising ? res.first > alpha : res.first < beta)) {
+                res = alphabeta(board, alpha, beta, depth - 1, !isEnemy, m,
+                                ply + 1);
+            }
+            board >> m;
 
-                if (res.first < minValue) {
-                    minValue = res.first;
+            if (isMaximising) {
+                // Is a maximising player
+                if (res.first > bestValue) {
+                    bestValue = res.first;
                     resultMove = m;
                 }
-                beta = std::min(beta, res.first);
-                if (beta <= alpha) {
-                    break;
+                alpha = std::max(alpha, res.first);
+            } else {
+                // Is a minimising player
+                if (res.first < bestValue) {
+                    bestValue = res.first;
+                    resultMove = m;
                 }
+                beta = std::min(beta, res.first);
+            }
+
+            if (beta <= alpha) {
+                m_history[cellIndex(m.pos)] += depth * depth;
+                break;
             }
-            return {minValue, resultMove};
         }
+
+        Bound bound{bestValue <= alphaOrig   ? Bound::Upper
+                    : bestValue >= betaOrig ? Bound::Lower
+                                            : Bound::Exact};
+        m_table.store(key, bestValue, depth, bound, resultMove.pos.x);
+
+        return {bestValue, resultMove};
     }
 
     Move getNextMove(Board<S_ROWS, S_COLS>& board) override {
         Board<S_ROWS, S_COLS> newBoard(board);
-        Move dummy{};
-        auto [_, res]{alphabeta(newBoard, std::numeric_limits<long>::min(),
-                                std::numeric_limits<long>::max(), m_depth,
-                                false, dummy)};
+
+        for (long& h : m_history) {
+            h /= 2;
+        }
+
+        // The transposition table survives between calls, so the shallow
+        // iterations are mostly table hits and only order the deeper ones.
+        Move res{};
+        for (int depth{1}; depth <= m_depth; ++depth) {
+            Move dummy{};
+            auto [score, move]{alphabeta(newBoard,
+                                         std::numeric_limits<long>::min(),
+                                         std::numeric_limits<long>::max(),
+                                         depth, false, dummy)};
+            res = move;
+
+            if (std::abs(score) >= winScore) {
+                break;
+            }
+        }
 
         return res;
     }
 
    private:
+    static int cellIndex(Vec2i pos) { return pos.y * S_COLS + pos.x; }
+
+    // The first three moves at a node are always searched in full, later
+    // ones lose a ply, and a second one deep in the tree.
+    static std::vector<std::vector<int>> defaultReductions(int maxDepth) {
+        std::vector<std::vector<int>> reductions(
+            maxDepth + 1, std::vector<int>(S_COLS, 0));
+        for (int depth{3}; depth <= maxDepth; ++depth) {
+            for (int i{3}; i < static_cast<int>(S_COLS); ++i) {
+                reductions[depth][i] = (depth >= 6 && i >= 5) ? 2 : 1;
+            }
+        }
+        return reductions;
+    }
+
+    int reductionFor(long depth, int moveIndex) const {
+        if (m_reductions.empty()) {
+            return 0;
+        }
+        const auto& row{m_reductions[std::min<size_t>(
+            depth, m_reductions.size() - 1)]};
+        if (row.empty()) {
+            return 0;
+        }
+        int reduction{row[std::min<size_t>(moveIndex, row.size() - 1)]};
+        // Never reduce straight into the horizon.
+        return std::clamp<int>(reduction, 0, depth - 1);
+    }
+
+    // Hash move first, then moves that caused cutoffs before, then the
+    // centre columns.
+    std::vector<Vec2i> orderPositions(const Board<S_ROWS, S_COLS>& board,
+                                      int hashColumn) {
+        std::vector<Vec2i> positions{generateValidPositions(board)};
+
+        auto priority{[&](Vec2i p) -> long {
+            if (p.x == hashColumn) {
+                return std::numeric_limits<long>::max();
+            }
+            return m_history[cellIndex(p)] * static_cast<long>(S_COLS) -
+                   std::abs(2 * p.x - static_cast<int>(S_COLS) + 1);
+        }};
+        std::stable_sort(positions.begin(), positions.end(),
+                         [&](Vec2i a, Vec2i b) {
+                             return priority(a) > priority(b);
+                         });
+        return positions;
+    }
+
     int m_depth;
     std::string m_name;
     Tile m_tile;
     Tile m_enemyTile;
+
+    // Kept across calls so the next search starts from what this one learnt.
+    TranspositionTable m_table;
+    std::array<long, S_ROWS * S_COLS> m_history;
+
+    std::vector<std::vector<int>> m_reductions;
 };
 
+// Outcome of a node from the point of view of the player whose move led to
+// it. Children start out Unvisited, their board is only looked at when the
+// search first steps into them. Win and Draw are set there when the move ends
+// the game; afterwards Win, Loss and Draw are also proven from the children
+// (MCTS-Solver).
+enum class NodeState : uint8_t { Unvisited, Open, Win, Loss, Draw };
+
+// Every node of a search, stored as parallel arrays indexed by node. A node is
+// just its statistics, the column that led to it and where its children are,
+// bytesPerNode() in total; boards are rebuilt from the root while descending.
+// The children of a node are allocated together the first time it is
+// expanded, as the range [firstChild, firstChild + childCount), so picking one
+// scans a few adjacent entries of each array. Starting a new search only
+// rewinds the size, the arrays keep their capacity.
 template <size_t S_ROWS, size_t S_COLS>
-class MonteCarloNode {
+class MonteCarloTree {
    public:
-    int visits;
-    int wins;
+    static constexpr uint32_t root{0};
+
+    // Per player wins: +1 for a win, -1 for a loss, 0 for a draw.
+    std::vector<int32_t> visits;
+    std::vector<int32_t> wins;
+    std::vector<uint32_t> firstChild;
+    std::vector<int8_t> column;
+    std::vector<uint8_t> childCount;
+    std::vector<NodeState> state;
+    // All-moves-as-first statistics, see MonteCarloPlayer::setRave(). Same
+    // perspective as `wins`. Empty unless setRave() turned them on.
+    std::vector<int32_t> raveVisits;
+    std::vector<int32_t> raveWins;
+    // The node that holds the statistics and children of this node's
+    // position, see target(). Empty without a transposition table.
+    std::vector<uint32_t> canonical;
 
    public:
-    MonteCarloNode(Tile t_turn, Board<S_ROWS, S_COLS>& t_board)
-        : m_isTerminal(false),
-          m_winState(0),
-          m_turn(t_turn),
-          m_isFullyExpanded(false),
-          visits(0),
-          wins(0),
-          m_board(t_board),
-          m_parent(nullptr) {
-        m_maxChildren = generateValidPositions(m_board).size();
+    MonteCarloTree()
+        : m_size(0),
+          m_turn(Tile::Empty),
+          m_generation(1),
+          m_nodeLimit(0),
+          m_rave(false) {}
+
+    void reset(const Board<S_ROWS, S_COLS>& board, Tile turn) {
+        m_board = board;
+        m_turn = turn;
+        m_size = 0;
+        ++m_generation;
+        state[allocate(1)] = NodeState::Open;
+    }
+
+    // Where to read and update `node`: itself, or with a transposition table
+    // the first node made for the same position, which makes the tree a DAG.
+    // Only the column stays the node's own.
+    uint32_t target(uint32_t node) const {
+        return canonical.empty() ? node : canonical[node];
+    }
+
+    // Whether the nodes keep RAVE statistics. Turning them on starts them at
+    // zero for every node.
+    void setRave(bool rave) {
+        if (rave != m_rave) {
+            m_rave = rave;
+            grow(visits.size());
+        }
+    }
+
+    // Number of positions remembered to find transpositions, 0 for none.
+    // Nodes already in the tree stay their own targets.
+    void setTableSize(size_t entries) {
+        const bool hadTable{!m_table.empty()};
+        m_table.assign(entries, {});
+        if (hadTable != (entries > 0)) {
+            grow(visits.size());
+            std::iota(canonical.begin(), canonical.end(), 0);
+        }
+    }
+
+    // The node already made for the position with `key`, or `node` after
+    // remembering it for that position. Slots are simply overwritten, so a
+    // full table only misses transpositions.
+    uint32_t findOrInsert(uint64_t key, uint32_t node) {
+        if (m_table.empty()) {
+            return node;
+        }
+        TableEntry& entry{
+            m_table[(key * 0x9e3779b97f4a7c15ULL) % m_table.size()]};
+        if (entry.generation == m_generation && entry.key == key) {
+            return entry.node;
+        }
+        entry = {key, node, m_generation};
+        return node;
+    }
+
+    // Most nodes the arrays may ever hold, 0 for no limit. A bigger tree is
+    // dropped.
+    void setNodeLimit(size_t nodes) {
+        m_nodeLimit = nodes;
+        if (m_nodeLimit > 0 && visits.size() > m_nodeLimit) {
+            m_size = 0;
+            grow(0);
+        }
+    }
+
+    size_t nodeLimit() const { return m_nodeLimit; }
+
+    // Whether allocate() can hand out `count` more nodes within the limit.
+    bool hasRoom(uint32_t count) const {
+        return m_nodeLimit == 0 || m_size + count <= m_nodeLimit;
     }
 
-    ~MonteCarloNode() {
-        for (auto child : children) {
-            delete child.second;
+    static constexpr size_t tableEntryBytes() { return sizeof(TableEntry); }
+
+    // Bytes of every node in the arrays, with the optional ones in use.
+    size_t bytesPerNode() const {
+        size_t res{2 * sizeof(int32_t) + sizeof(uint32_t) + sizeof(int8_t) +
+                   sizeof(uint8_t) + sizeof(NodeState)};
+        if (m_rave) {
+            res += 2 * sizeof(int32_t);
+        }
+        if (!m_table.empty()) {
+            res += sizeof(uint32_t);
         }
+        return res;
     }
 
-    bool isTerminal() {
-        if (!m_isTerminal) {
-            auto [terminal, score]{evaluate(m_board)};
-            m_isTerminal = !!terminal;
+    // Bytes held by the arrays and the transposition table.
+    size_t memoryUsage() const {
+        return visits.capacity() * bytesPerNode() +
+               m_table.capacity() * sizeof(TableEntry);
+    }
 
-            if (terminal) {
-                m_winState = terminal.value();
+    // Returns the index of the first of `count` fresh, adjacent nodes.
+    uint32_t allocate(uint32_t count) {
+        if (m_size + count > visits.size()) {
+            size_t capacity{
+                std::max<size_t>(2 * visits.size(), m_size + count)};
+            if (m_nodeLimit > 0) {
+                capacity = std::max<size_t>(std::min(capacity, m_nodeLimit),
+                                            m_size + count);
             }
+            grow(capacity);
         }
-        return m_isTerminal;
+
+        uint32_t first{m_size};
+        m_size += count;
+        clear(first, count);
+        return first;
     }
 
-    bool isFullyExpanded() {
-        if (!m_isFullyExpanded && m_maxChildren == children.size()) {
-            m_isFullyExpanded = true;
+    // Same as allocate(), but safe to call from several threads at once. The
+    // arrays can't move under the other threads, so this fails instead of
+    // growing once the reserved capacity is used up.
+    std::optional<uint32_t> tryAllocate(uint32_t count) {
+        std::atomic_ref<uint32_t> size{m_size};
+        uint32_t first{size.load(std::memory_order_relaxed)};
+        do {
+            if (first + count > visits.size()) {
+                return {};
+            }
+        } while (!size.compare_exchange_weak(first, first + count,
+                                             std::memory_order_relaxed));
+
+        clear(first, count);
+        return first;
+    }
+
+    void reserve(size_t capacity) {
+        if (m_nodeLimit > 0) {
+            capacity = std::min(capacity, m_nodeLimit);
         }
-        return m_isFullyExpanded;
+        if (capacity > visits.size()) {
+            grow(capacity);
+        }
+    }
+
+    // Accessors for searches sharing the tree between threads. Plain loads
+    // compile to the same instructions, so the single threaded search uses
+    // them too.
+    template <typename T>
+    static T load(T& value,
+                  std::memory_order order = std::memory_order_relaxed) {
+        return std::atomic_ref<T>(value).load(order);
+    }
+
+    template <typename T>
+    static void store(T& value, T newValue,
+                      std::memory_order order = std::memory_order_relaxed) {
+        std::atomic_ref<T>(value).store(newValue, order);
     }
 
-    bool applyMove(Move move) {
-        if (m_board << move) {
-            m_maxChildren = generateValidPositions(m_board).size();
+    template <typename T>
+    static void add(T& value, T delta) {
+        std::atomic_ref<T>(value).fetch_add(delta, std::memory_order_relaxed);
+    }
 
-            isTerminal();
-            isFullyExpanded();
-            m_turn = getEnemyTile(m_turn);
+    // Rebuilds this tree from the subtree of `node` in `other`, with `node` as
+    // the new root and `board` its position. Nodes are copied breadth first so
+    // sibling blocks stay contiguous; everything outside the subtree is
+    // dropped.
+    void copySubtree(const MonteCarloTree& other, uint32_t node,
+                     const Board<S_ROWS, S_COLS>& board, Tile turn) {
+        copyExpanded(other, node, board, turn, [](uint32_t) { return true; });
+    }
 
-            return true;
+    // Rebuilds this tree from `other` in at most `nodes` nodes: only the
+    // most visited nodes keep their children, the others become leaves again
+    // with their own statistics intact. The root always keeps its children.
+    // `expanded` is scratch space; with room reserved for every node of
+    // `other`, pruning allocates nothing.
+    void copyPruned(const MonteCarloTree& other, size_t nodes,
+                    std::vector<uint32_t>& expanded) {
+        expanded.clear();
+        for (uint32_t i{0}; i < other.m_size; ++i) {
+            if (other.childCount[i] > 0) {
+                expanded.push_back(i);
+            }
         }
-        return false;
+        std::sort(expanded.begin(), expanded.end(),
+                  [&](uint32_t a, uint32_t b) {
+                      return (a == root) != (b == root)
+                                 ? a == root
+                                 : other.visits[a] > other.visits[b];
+                  });
+
+        size_t kept{1};
+        auto last{expanded.begin()};
+        for (; last != expanded.end(); ++last) {
+            if (*last != root && kept + other.childCount[*last] > nodes) {
+                break;
+            }
+            kept += other.childCount[*last];
+        }
+        // The nodes keeping their children, by index to look them up.
+        std::sort(expanded.begin(), last);
+        copyExpanded(other, root, other.m_board, other.m_turn,
+                     [&](uint32_t i) {
+                         return std::binary_search(expanded.begin(), last, i);
+                     });
     }
 
-    MonteCarloNode* createChild(Move move) {
-        MonteCarloNode* newNode{new MonteCarloNode(m_turn, m_board)};
-        newNode->applyMove(move);
-        newNode->m_parent = this;
-        children[move] = newNode;
+    uint32_t size() const { return m_size; }
 
-        return newNode;
+    const Board<S_ROWS, S_COLS>& rootBoard() const { return m_board; }
+    Tile rootTurn() const { return m_turn; }
+
+   private:
+    // Rebuilds this tree from the nodes of `other` below `node`, leaving out
+    // the children of those `keepChildren` rejects.
+    template <typename KeepChildren>
+    void copyExpanded(const MonteCarloTree& other, uint32_t node,
+                      const Board<S_ROWS, S_COLS>& board, Tile turn,
+                      KeepChildren keepChildren) {
+        m_board = board;
+        m_turn = turn;
+        m_size = 0;
+        ++m_generation;
+
+        // Until a node's own children are copied, its firstChild holds its
+        // index in `other`, so the new nodes double as the BFS queue.
+        copyNode(other, node, allocate(1));
+        firstChild[root] = node;
+        for (uint32_t i{0}; i < m_size; ++i) {
+            uint32_t from{firstChild[i]};
+            if (other.childCount[from] == 0 || !keepChildren(from)) {
+                firstChild[i] = 0;
+                childCount[i] = 0;
+                continue;
+            }
+
+            uint32_t block{allocate(other.childCount[from])};
+            firstChild[i] = block;
+            for (uint32_t k{0}; k < other.childCount[from]; ++k) {
+                copyNode(other, other.firstChild[from] + k, block + k);
+                firstChild[block + k] = other.firstChild[from] + k;
+            }
+        }
     }
 
-    std::vector<Move> getExpandedMoves() {
-        std::vector<Move> moves;
-        moves.reserve(children.size());
-        for (auto [move, child] : children) {
-            moves.push_back(move);
+    void clear(uint32_t first, uint32_t count) {
+        for (uint32_t i{first}; i < first + count; ++i) {
+            visits[i] = 0;
+            wins[i] = 0;
+            firstChild[i] = 0;
+            column[i] = -1;
+            childCount[i] = 0;
+            state[i] = NodeState::Unvisited;
+            if (m_rave) {
+                raveVisits[i] = 0;
+                raveWins[i] = 0;
+            }
+            if (!m_table.empty()) {
+                canonical[i] = i;
+            }
         }
-        return moves;
     }
 
-    std::optional<MonteCarloNode*> getChildForMove(Move move) {
-        if (children.find(move) == children.end()) {
-            return {};
+    void copyNode(const MonteCarloTree& other, uint32_t from, uint32_t to) {
+        visits[to] = other.visits[from];
+        wins[to] = other.wins[from];
+        column[to] = other.column[from];
+        childCount[to] = other.childCount[from];
+        state[to] = other.state[from];
+        if (m_rave) {
+            raveVisits[to] = other.m_rave ? other.raveVisits[from] : 0;
+            raveWins[to] = other.m_rave ? other.raveWins[from] : 0;
+        }
+    }
+
+    // Sets every array in use to exactly `capacity` entries, also in
+    // memory, and frees the others.
+    void grow(size_t capacity) {
+        auto fit{[](auto& array, size_t size) {
+            if (size < array.capacity()) {
+                array.resize(size);
+                array.shrink_to_fit();
+            } else {
+                array.reserve(size);
+                array.resize(size);
+            }
+        }};
+        fit(visits, capacity);
+        fit(wins, capacity);
+        fit(firstChild, capacity);
+        fit(column, capacity);
+        fit(childCount, capacity);
+        fit(state, capacity);
+        fit(raveVisits, m_rave ? capacity : 0);
+        fit(raveWins, m_rave ? capacity : 0);
+        fit(canonical, m_table.empty() ? 0 : capacity);
+    }
+
+    struct TableEntry {
+        uint64_t key;
+        uint32_t node;
+        // Entries of earlier searches are stale, which saves clearing.
+        uint32_t generation;
+    };
+
+    uint32_t m_size;
+    Board<S_ROWS, S_COLS> m_board;
+    Tile m_turn;
+    std::vector<TableEntry> m_table;
+    uint32_t m_generation;
+    size_t m_nodeLimit;
+    bool m_rave;
+};
+
+// The board of the node a descent has reached, rebuilt move by move from the
+// root position.
+template <size_t S_ROWS, size_t S_COLS>
+struct TreeCursor {
+    BitBoard<S_ROWS, S_COLS> board;
+    Tile turn;
+
+    TreeCursor(const Board<S_ROWS, S_COLS>& t_board, Tile t_turn)
+        : board(t_board), turn(t_turn) {}
+
+    // Whether the move ended the game, with a win for the player making it
+    // or with the board full.
+    std::optional<long> play(int column) {
+        Tile mover{turn};
+        board.play(column, mover);
+        turn = getEnemyTile(turn);
+
+        if (BitBoard<S_ROWS, S_COLS>::hasWon(
+                board.stones[BitBoard<S_ROWS, S_COLS>::side(mover)])) {
+            return static_cast<long>(mover);
+        } else if (!board.playable()) {
+            return 0;
         }
-        return children[move];
+        return {};
     }
+};
 
-    const Board<S_ROWS, S_COLS>& getBoard() { return m_board; }
+// How several threads share the work of one search. Root parallelisation
+// grows an independent tree per thread; tree parallelisation has all threads
+// descend one shared tree, using atomic statistics and virtual loss; leaf
+// parallelisation has one thread descend the tree and all of them run the
+// playouts of each leaf batch.
+enum class Parallelism { Root, Tree, Leaf };
 
-    Tile getTurn() { return m_turn; }
+// Threads that stay parked between tasks, so that handing out work as small
+// as one batch of playouts is cheap.
+class ThreadPool {
+   public:
+    // `t_nThreads` counts the calling thread, which takes part in every run.
+    explicit ThreadPool(int t_nThreads)
+        : m_nThreads(t_nThreads),
+          m_start(t_nThreads),
+          m_done(t_nThreads),
+          m_task(nullptr),
+          m_stop(false) {
+        for (int i{1}; i < m_nThreads; ++i) {
+            m_threads.emplace_back([this, i] { work(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        m_stop = true;
+        m_start.arrive_and_wait();
+        for (auto& thread : m_threads) {
+            thread.join();
+        }
+    }
 
-    MonteCarloNode* getParent() { return m_parent; }
+    int size() const { return m_nThreads; }
 
-    std::optional<long> getWinState() {
-        isTerminal();
-        return m_winState;
+    // Calls task(i) once for every thread index i and returns when all are
+    // done. Index 0 runs on the calling thread.
+    void run(const std::function<void(int)>& task) {
+        m_task = &task;
+        m_start.arrive_and_wait();
+        task(0);
+        m_done.arrive_and_wait();
     }
 
    private:
-    Board<S_ROWS, S_COLS> m_board;
+    void work(int index) {
+        while (true) {
+            m_start.arrive_and_wait();
+            if (m_stop) {
+                return;
+            }
+            (*m_task)(index);
+            m_done.arrive_and_wait();
+        }
+    }
+
+    int m_nThreads;
+    std::barrier<> m_start;
+    std::barrier<> m_done;
+    const std::function<void(int)>* m_task;
+    bool m_stop;
+    std::vector<std::thread> m_threads;
+};
 
-    // A Win, Lose, Draw situation
-    bool m_isTerminal;
-    long m_winState;
+// What one search may spend, shared by the threads working on the same tree.
+struct SearchBudget {
+    using Clock = std::chrono::steady_clock;
 
-    Tile m_turn;
-    int m_maxChildren;
-    // If all the moves which can be applied to the node have been applied. In
-    // other words the number of moves you can make in this board position equal
-    // to the number oof children it has.
-    bool m_isFullyExpanded;
-    MonteCarloNode* m_parent;
-    std::unordered_map<Move, MonteCarloNode*> children;
+    int simulations{0};
+    Clock::time_point start;
+    std::optional<Clock::time_point> deadline;
+    // Stop once the most visited root move can no longer be overtaken.
+    bool stopWhenSettled{false};
+
+    // Playouts handed out so far.
+    std::atomic<int> claimed{0};
+    std::atomic<bool> stop{false};
+};
+
+template <size_t S_ROWS, size_t S_COLS>
+struct MonteCarloWorker {
+    MonteCarloTree<S_ROWS, S_COLS> tree;
+    // Only the target when re-rooting the tree, kept for its memory.
+    MonteCarloTree<S_ROWS, S_COLS> spareTree;
+    Random rng;
+    // Times the tree was pruned to stay under its node limit this move.
+    int prunes{0};
+    // Runs batched playouts, see MonteCarloPlayer::setLeafBatch().
+    RolloutLanes<S_ROWS, S_COLS> lanes;
+    // Scratch space for pruning the tree, reserved with the node limit.
+    std::vector<uint32_t> pruneOrder;
 };
 
 template <size_t S_ROWS, size_t S_COLS>
 class MonteCarloPlayer : public Player<S_ROWS, S_COLS> {
    public:
-    MonteCarloPlayer(int t_nSimulations, int t_c, std::string_view t_name,
-                     Tile t_tile)
-        : m_nSimulation(t_nSimulations),
-          m_c(t_c),
+    // The simulations are shared out between `t_nThreads` independent trees
+    // (root parallelisation), whose root visit counts are added up to pick
+    // the move.
+    MonteCarloPlayer(int t_nSimulations, float t_c, int t_nThreads,
+                     std::string_view t_name, Tile t_tile)
+        : m_c(t_c),
+          m_nSimulation(t_nSimulations),
+          m_nThreads(std::max(1, t_nThreads)),
+          m_tile(t_tile),
           m_name(t_name),
-          m_tile(t_tile) {}
+          m_parallelism(Parallelism::Root),
+          m_leafBatch(0),
+          m_timeBudget(0),
+          m_earlyStop(true),
+          m_policy(RolloutPolicy::uniform()),
+          m_raveEquivalence(0),
+          m_transpositions(0),
+          m_probeDepth(0),
+          m_probeAfter(0),
+          m_expandTerminals(false),
+          m_sequentialHalving(false),
+          m_memoryLimit(0),
+          m_workers(m_nThreads) {
+        seed(std::random_device{}());
+    }
+
+    // Gives every thread its own stream. Runs with the same seed, settings
+    // and thread count play the same moves in root parallel mode or with a
+    // single thread, as long as there is no time budget. Tree and leaf
+    // parallel searches also depend on how the threads are scheduled.
+    void seed(uint64_t t_seed) {
+        for (size_t i{0}; i < m_workers.size(); ++i) {
+            m_workers[i].rng.seed(t_seed + i * 0x632be59bd9b4e019ULL);
+            m_workers[i].lanes.seed(m_workers[i].rng);
+        }
+    }
+
+    // How the threads share a search, see Parallelism. Root parallel is the
+    // default. Leaf parallel mode only has work for the other threads when a
+    // leaf gets several playouts, so unless setLeafBatch() says otherwise it
+    // runs one per thread.
+    void setParallelism(Parallelism t_parallelism) {
+        m_parallelism = t_parallelism;
+        applyMemoryLimit();
+    }
+
+    // Number of playouts run from every new leaf, backpropagated together.
+    // They are played several at a time on SIMD lanes, and spread over the
+    // threads in leaf parallel mode. The simulation count stays the total
+    // number of playouts. The default is one, or one per thread in leaf
+    // parallel mode.
+    void setLeafBatch(int t_leafBatch) {
+        m_leafBatch = std::max(1, t_leafBatch);
+    }
+
+    // Wall-clock limit per move, on top of the simulation count. 0 turns it
+    // off; with a large simulation count the budget alone decides.
+    void setTimeBudget(std::chrono::milliseconds t_timeBudget) {
+        m_timeBudget = t_timeBudget;
+    }
+
+    // Stop a search as soon as the most visited move is certain to stay so.
+    // Only a single tree is checked, so independent root parallel trees
+    // always spend their whole budget.
+    void setEarlyStop(bool t_earlyStop) { m_earlyStop = t_earlyStop; }
+
+    // How playouts pick their moves, uniformly at random by default.
+    // RolloutPolicy::heavy() playouts cost more each but judge a position
+    // far better.
+    void setRolloutPolicy(RolloutPolicy t_policy) { m_policy = t_policy; }
+
+    // Rapid action value estimation: selection also looks at how playouts
+    // went whenever a move's cell was filled by the same player later on,
+    // which gives every move an estimate long before it has many visits of
+    // its own. The AMAF mean and the mean weigh the same at
+    // `t_equivalence` visits, after which the mean takes over. 0 turns it
+    // off. Leaf batches of more than one playout don't feed it. RAVE wants
+    // much less exploration, a UCT constant around 0.3.
+    void setRave(int t_equivalence) {
+        m_raveEquivalence = static_cast<float>(std::max(0, t_equivalence));
+        for (auto& worker : m_workers) {
+            worker.tree.setRave(m_raveEquivalence > 0);
+            worker.spareTree.setRave(m_raveEquivalence > 0);
+        }
+        applyMemoryLimit();
+    }
+
+    // Minimax in the tree: a node gets a `t_depth` ply alpha-beta probe
+    // when the search passes through it with `t_afterVisits` visits, 0 being
+    // its first visit. A forced win or loss found there settles the node like
+    // a finished game, so short tactics show up without waiting for playouts
+    // to find them. Later switch points probe fewer, better established
+    // nodes. A depth of 0 turns it off.
+    void setMinimaxProbe(int t_depth, int t_afterVisits = 0) {
+        m_probeDepth = std::max(0, t_depth);
+        m_probeAfter = std::max(0, t_afterVisits);
+    }
+
+    // Expand nodes knowing which children end the game: a move that wins is
+    // marked as such and becomes the node's only child, proving the node at
+    // its next visit, and a move into the last cell is marked a draw.
+    // Otherwise a child's result is only found when the search first steps
+    // into it.
+    void setExpandTerminals(bool t_expandTerminals) {
+        m_expandTerminals = t_expandTerminals;
+    }
+
+    // Pick the move by sequential halving instead of UCT at the root: every
+    // move gets its fair share of a first round, and each round after drops
+    // the worse half and splits the same amount between the rest. Meant for
+    // budgets of a few hundred simulations, where it finds the best move
+    // about as often as UCT does, no more, and loses more games to it.
+    // The simulation count is what gets divided up; trees are not reused
+    // between moves, early stopping is off, and tree parallel search ignores
+    // it.
+    void setSequentialHalving(bool t_sequentialHalving) {
+        m_sequentialHalving = t_sequentialHalving;
+    }
+
+    // Merge transpositions: a child whose position is already in the tree
+    // shares that node's statistics and children, turning the tree into a
+    // DAG so the simulations go to distinct positions. `t_entries` bounds the
+    // table of positions, 0 turns it off. Trees start afresh every move in
+    // this mode, and tree parallel search ignores it.
+    void setTranspositions(size_t t_entries) {
+        m_transpositions = t_entries;
+        for (auto& worker : m_workers) {
+            worker.tree.setTableSize(t_entries);
+        }
+        applyMemoryLimit();
+    }
+
+    // Keeps the search trees of all threads within `t_bytes`, 0 for no
+    // limit. What the transposition tables leave is split evenly between
+    // the threads searching: every thread in root parallel mode, the first
+    // one in the other modes. Each gets two trees, the second one only being
+    // the target when the tree is moved between searches, and the scratch
+    // space for pruning. A full tree prunes the children of its least
+    // visited nodes down to half its limit and carries on; in tree parallel
+    // or transposition mode it stops growing instead.
+    void setMemoryLimit(size_t t_bytes) {
+        m_memoryLimit = t_bytes;
+        applyMemoryLimit();
+    }
+
+    struct MemoryUsage {
+        // Nodes holding part of the current search.
+        size_t nodes{0};
+        // Everything allocated for the trees, tables included.
+        size_t bytes{0};
+        // Times a full tree was pruned during the last move.
+        int prunes{0};
+    };
+
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage;
+        for (const auto& worker : m_workers) {
+            usage.nodes += worker.tree.size();
+            usage.bytes += worker.tree.memoryUsage() +
+                           worker.spareTree.memoryUsage() +
+                           worker.pruneOrder.capacity() * sizeof(uint32_t);
+            usage.prunes += worker.prunes;
+        }
+        return usage;
+    }
 
    public:
     std::string_view getFriendlyName() override { return m_name; }
     Tile getPlayerTile() override { return m_tile; }
 
-    std::pair<Move, MonteCarloNode<S_ROWS, S_COLS>*> bestUCT(
-        MonteCarloNode<S_ROWS, S_COLS>* node) {
-        float maxVal{-std::numeric_limits<float>::max()};
-        std::pair<Move, MonteCarloNode<S_ROWS, S_COLS>*> res{};
+    // An unvisited child if there is one, otherwise the child with the best
+    // UCT value for the player moving into it. Children proven won or lost
+    // are skipped, there is nothing left to learn about them; a proven draw
+    // stays in, it is cheap to visit and its value is exact. With RAVE the
+    // mean is blended with the AMAF mean, and unvisited children are tried
+    // best AMAF mean first.
+    uint32_t bestUCT(MonteCarloTree<S_ROWS, S_COLS>& tree, uint32_t node) {
+        using Tree = MonteCarloTree<S_ROWS, S_COLS>;
+        uint32_t first{Tree::load(tree.firstChild[node],
+                                  std::memory_order_acquire)};
+        uint32_t count{Tree::load(tree.childCount[node])};
+
+        int32_t parentVisits{Tree::load(tree.visits[node])};
+        float maxAmaf{-std::numeric_limits<float>::max()};
+        std::optional<uint32_t> unvisited;
+        for (uint32_t child{first}; child < first + count; ++child) {
+            uint32_t target{tree.target(child)};
+            if (Tree::load(tree.visits[target]) != 0 || settled(tree, target)) {
+                continue;
+            }
+            if (m_raveEquivalence == 0) {
+                return child;
+            }
+            float amaf{amafMean(tree, child)};
+            if (amaf > maxAmaf) {
+                maxAmaf = amaf;
+                unvisited = child;
+            }
+        }
+        if (unvisited) {
+            return unvisited.value();
+        }
+        if (m_transpositions > 0) {
+            // In a DAG the children also count visits through other parents.
+            int32_t childVisits{0};
+            for (uint32_t child{first}; child < first + count; ++child) {
+                childVisits += Tree::load(tree.visits[tree.target(child)]);
+            }
+            parentVisits = std::max(parentVisits, childVisits);
+        }
+
+        // Every child has visits now. The loop below keeps to selects instead
+        // of branches: proven children just get the lowest score. log(N) is
+        // looked up once per node.
+        constexpr float excluded{-std::numeric_limits<float>::max()};
+        const float exploration{m_c * sqrtLog(parentVisits)};
+        const float raveScale{std::sqrt(m_raveEquivalence)};
+        // Only kept when every child is proven, which the node itself will be
+        // as soon as backpropagate() gets to it.
+        uint32_t res{first};
+        float maxVal{excluded};
+        for (uint32_t child{first}; child < first + count; ++child) {
+            uint32_t target{tree.target(child)};
+            float n{static_cast<float>(Tree::load(tree.visits[target]))};
+            float mean{static_cast<float>(Tree::load(tree.wins[target])) / n};
+            if (m_raveEquivalence > 0 &&
+                Tree::load(tree.raveVisits[child]) > 0) {
+                // Gelly and Silver's schedule: AMAF and the mean weigh the
+                // same at `m_raveEquivalence` visits.
+                float beta{raveScale * fastRsqrt(3 * n + m_raveEquivalence)};
+                mean += beta * (amafMean(tree, child) - mean);
+            }
+            float val{settled(tree, target)
+                          ? excluded
+                          : mean + exploration * fastRsqrt(n)};
+            bool better{val > maxVal};
+            maxVal = better ? val : maxVal;
+            res = better ? child : res;
+        }
+        return res;
+    }
+
+    // Proven won or lost, never selected again.
+    static bool settled(MonteCarloTree<S_ROWS, S_COLS>& tree, uint32_t node) {
+        NodeState state{MonteCarloTree<S_ROWS, S_COLS>::load(tree.state[node])};
+        return state == NodeState::Win || state == NodeState::Loss;
+    }
 
-        std::vector<Move> allMoves{node->getExpandedMoves()};
+    // Gives the node its children. On a shared tree another thread may get
+    // there first, the block that loses is then simply never used. Fails
+    // when a shared tree runs out of reserved nodes, or a tree reaches its
+    // node limit.
+    template <bool t_shared>
+    bool expand(MonteCarloTree<S_ROWS, S_COLS>& tree, uint32_t node,
+                const TreeCursor<S_ROWS, S_COLS>& cursor) {
+        using Tree = MonteCarloTree<S_ROWS, S_COLS>;
+        using Bits = BitBoard<S_ROWS, S_COLS>;
+        uint64_t moves{cursor.board.playable()};
+        uint64_t wins{0};
+        if (m_expandTerminals) {
+            wins = moves & Bits::winningCells(
+                               cursor.board.stones[Bits::side(cursor.turn)],
+                               cursor.board.mask);
+            // One winning move settles the node, the others don't matter.
+            if (wins) {
+                moves = wins & (0 - wins);
+            }
+        }
+        uint8_t count{static_cast<uint8_t>(std::popcount(moves))};
+
+        std::optional<uint32_t> block;
+        if (t_shared) {
+            block = tree.tryAllocate(count);
+        } else if (tree.hasRoom(count)) {
+            block = tree.allocate(count);
+        }
+        if (!block) {
+            return false;
+        }
+        uint32_t child{block.value()};
+        for (int column{0}; column < static_cast<int>(S_COLS); ++column) {
+            if (moves & BitBoard<S_ROWS, S_COLS>::columnMask(column)) {
+                tree.column[child++] = column;
+            }
+        }
+        // Children whose position is already in the tree share its node. The
+        // table is not thread safe, a shared tree stays a tree.
+        if (!t_shared && m_transpositions > 0) {
+            for (child = block.value(); child < block.value() + count;
+                 ++child) {
+                BitBoard<S_ROWS, S_COLS> after{cursor.board};
+                after.play(tree.column[child], cursor.turn);
+                tree.canonical[child] = tree.findOrInsert(after.key(), child);
+            }
+        }
+        // Games the children end are known from the masks already, so mark
+        // them now rather than when the search first steps into them.
+        if (m_expandTerminals) {
+            const bool lastCell{std::popcount(cursor.board.mask) + 1 ==
+                                static_cast<int>(S_ROWS * S_COLS)};
+            for (child = block.value(); child < block.value() + count;
+                 ++child) {
+                NodeState& state{tree.state[tree.target(child)]};
+                if (wins) {
+                    Tree::store(state, NodeState::Win);
+                } else if (lastCell) {
+                    Tree::store(state, NodeState::Draw);
+                }
+            }
+        }
 
-        for (auto move : allMoves) {
-            MonteCarloNode<S_ROWS, S_COLS>* child{
-                node->getChildForMove(move)
-                    .value()};  // Here a check isn't neccesary because we
-                                // are accessing the already existing
-                                // children.
+        if constexpr (t_shared) {
+            Tree::store(tree.childCount[node], count);
+            uint32_t unexpanded{0};
+            std::atomic_ref<uint32_t>(tree.firstChild[node])
+                .compare_exchange_strong(unexpanded, block.value(),
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed);
+        } else {
+            tree.childCount[node] = count;
+            tree.firstChild[node] = block.value();
+        }
+        return true;
+    }
 
-            float cq{static_cast<float>(child->wins)};
-            float cn{static_cast<float>(child->visits)};
+    // Walks down from the root until it steps into a node for the first time
+    // or reaches a finished game, replaying the moves on the cursor. On a
+    // shared tree every node passed gets a virtual loss, steering the other
+    // threads towards different branches until backpropagate() settles it.
+    // The path and the returned leaf are the nodes stepped through, their
+    // statistics are at target(). `rootChild` picks the first step instead
+    // of UCT, counted from the root's first child.
+    template <bool t_shared>
+    uint32_t traverse(MonteCarloTree<S_ROWS, S_COLS>& tree,
+                      TreeCursor<S_ROWS, S_COLS>& cursor,
+                      std::vector<uint32_t>& path,
+                      std::optional<uint32_t> rootChild = {}) {
+        using Tree = MonteCarloTree<S_ROWS, S_COLS>;
+        uint32_t node{tree.root};
+        path.push_back(node);
+        if constexpr (t_shared) {
+            addVirtualLoss(tree, node);
+        }
 
-            float rn{static_cast<float>(node->visits)};
-            float val{cq / cn + m_c * std::sqrt(std::log(rn) / cn)};
+        while (Tree::load(tree.state[tree.target(node)]) == NodeState::Open) {
+            uint32_t position{tree.target(node)};
+            if (Tree::load(tree.firstChild[position],
+                           std::memory_order_acquire) == 0 &&
+                !expand<t_shared>(tree, position, cursor)) {
+                break;
+            }
+            node = position == tree.root && rootChild
+                       ? Tree::load(tree.firstChild[position]) +
+                             rootChild.value()
+                       : bestUCT(tree, position);
+            std::optional<long> result{cursor.play(tree.column[node])};
+            // Every pass adds a batch of visits, so this is the one pass
+            // that reaches the switch point.
+            int32_t visits{Tree::load(tree.visits[tree.target(node)])};
+            bool probe{m_probeDepth > 0 && visits <= m_probeAfter &&
+                       m_probeAfter < visits + leafBatch()};
+            path.push_back(node);
+            if constexpr (t_shared) {
+                addVirtualLoss(tree, node);
+            }
 
-            if (val > maxVal) {
-                maxVal = val;
-                res = {move, child};
+            NodeState& state{tree.state[tree.target(node)]};
+            bool unvisited{Tree::load(state) == NodeState::Unvisited};
+            if (unvisited) {
+                Tree::store(state, !result          ? NodeState::Open
+                                   : result.value() ? NodeState::Win
+                                                    : NodeState::Draw);
+            }
+            if (probe && Tree::load(state) == NodeState::Open) {
+                probeNode(tree, tree.target(node), cursor);
+            }
+            if (unvisited) {
+                break;
             }
         }
+        return node;
+    }
 
-        return res;
+    // Settles the node when a shallow alpha-beta from its position finds a
+    // forced result, which the solver then passes up the tree.
+    void probeNode(MonteCarloTree<S_ROWS, S_COLS>& tree, uint32_t node,
+                   const TreeCursor<S_ROWS, S_COLS>& cursor) {
+        int outcome{probeOutcome(cursor.board, cursor.turn, m_probeDepth)};
+        if (outcome != 0) {
+            // The cursor's turn is the opponent of the player moving into it.
+            MonteCarloTree<S_ROWS, S_COLS>::store(
+                tree.state[node],
+                outcome > 0 ? NodeState::Loss : NodeState::Win);
+        }
+    }
+
+    // Result of a random game from the cursor, +1 if Positive wins, -1 if
+    // Negative wins and 0 for a draw.
+    // The final position goes to `end` if given; for a settled node that is
+    // its own position.
+    long playout(MonteCarloTree<S_ROWS, S_COLS>& tree, uint32_t node,
+                 TreeCursor<S_ROWS, S_COLS>& cursor, Random& rng,
+                 BitBoard<S_ROWS, S_COLS>* end = nullptr) {
+        NodeState state{MonteCarloTree<S_ROWS, S_COLS>::load(
+            tree.state[tree.target(node)])};
+        if (end && state != NodeState::Open) {
+            *end = cursor.board;
+        }
+        if (state == NodeState::Win) {
+            return static_cast<long>(getEnemyTile(cursor.turn));
+        } else if (state == NodeState::Loss) {
+            return static_cast<long>(cursor.turn);
+        } else if (state == NodeState::Draw) {
+            return 0;
+        }
+
+        return randomRollout(cursor.board, cursor.turn, rng, m_policy, end);
     }
 
-    MonteCarloNode<S_ROWS, S_COLS>* expand(
-        MonteCarloNode<S_ROWS, S_COLS>* node) {
-        auto positions{generateValidPositions(node->getBoard())};
+    // Sum of `batch` playout results from the same leaf. In leaf parallel
+    // mode the batch is spread over the thread pool.
+    long playoutBatch(MonteCarloTree<S_ROWS, S_COLS>& tree, uint32_t node,
+                      const TreeCursor<S_ROWS, S_COLS>& cursor,
+                      MonteCarloWorker<S_ROWS, S_COLS>& worker, int batch) {
+        NodeState state{MonteCarloTree<S_ROWS, S_COLS>::load(
+            tree.state[tree.target(node)])};
+        if (state != NodeState::Open || batch == 1) {
+            TreeCursor<S_ROWS, S_COLS> copy{cursor};
+            return playout(tree, node, copy, worker.rng) * batch;
+        }
+
+        if (!m_pool) {
+            return worker.lanes.run(cursor.board, cursor.turn, batch, m_policy)
+                .sum();
+        }
+
+        const int nThreads{m_pool->size()};
+        std::vector<long> sums(nThreads, 0);
+        m_pool->run([&](int thread) {
+            int share{batch / nThreads + (thread < batch % nThreads)};
+            sums[thread] = m_workers[thread]
+                               .lanes.run(cursor.board, cursor.turn, share,
+                                          m_policy)
+                               .sum();
+        });
+        return std::accumulate(sums.begin(), sums.end(), 0L);
+    }
 
-        for (auto pos : positions) {
-            auto res{node->getChildForMove({pos, node->getTurn()})};
-            if (!res) {
-                return node->createChild({pos, node->getTurn()});
+    template <bool t_shared>
+    void backpropagate(MonteCarloTree<S_ROWS, S_COLS>& tree,
+                       const std::vector<uint32_t>& path,
+                       long playoutResults, int nPlayouts) {
+        using Tree = MonteCarloTree<S_ROWS, S_COLS>;
+        // Each node keeps score for the player who moved into it, the root's
+        // children are our moves. In a DAG only the positions on the path are
+        // updated, once each (a position can't repeat on a path), and what
+        // they learn reaches their other parents when those select them.
+        int32_t result{static_cast<int32_t>(
+            playoutResults * static_cast<int>(tree.rootTurn()))};
+
+        for (size_t i{0}; i < path.size(); ++i) {
+            uint32_t node{tree.target(path[i])};
+            if constexpr (t_shared) {
+                // Turn the virtual loss into the real result.
+                Tree::add(tree.visits[node], nPlayouts - virtualLoss);
+                if (i > 0) {
+                    Tree::add(tree.wins[node], result + virtualLoss);
+                }
+            } else {
+                tree.visits[node] += nPlayouts;
+                if (i > 0) {
+                    tree.wins[node] += result;
+                }
+            }
+            if (i > 0) {
+                result = -result;
             }
         }
 
-        return nullptr;
+        for (size_t i{path.size() - 1}; i > 0; --i) {
+            if (!prove<t_shared>(tree, tree.target(path[i - 1]))) {
+                break;
+            }
+        }
     }
 
-    MonteCarloNode<S_ROWS, S_COLS>* traverse(
-        MonteCarloNode<S_ROWS, S_COLS>* node) {
-        std::pair<Move, MonteCarloNode<S_ROWS, S_COLS>*> res{};
+    // Settles a node from its children when possible, by minimax: it is lost
+    // for the player who moved into it if the opponent has a winning reply,
+    // won if every reply loses, and drawn if every reply is settled and the
+    // best of them draws. Whether the node is proven now.
+    template <bool t_shared>
+    bool prove(MonteCarloTree<S_ROWS, S_COLS>& tree, uint32_t node) {
+        using Tree = MonteCarloTree<S_ROWS, S_COLS>;
+        if (Tree::load(tree.state[node]) != NodeState::Open) {
+            return false;
+        }
 
-        while (!node->isTerminal()) {
-            if (!node->isFullyExpanded()) {
-                return expand(node);
+        uint32_t first{Tree::load(tree.firstChild[node],
+                                  std::memory_order_acquire)};
+        uint32_t count{Tree::load(tree.childCount[node])};
+        if (first == 0) {
+            return false;
+        }
+        NodeState proven{NodeState::Win};
+        bool settled{true};
+        for (uint32_t child{first}; child < first + count; ++child) {
+            NodeState state{Tree::load(tree.state[tree.target(child)])};
+            if (state == NodeState::Win) {
+                proven = NodeState::Loss;
+                settled = true;
+                break;
+            } else if (state == NodeState::Draw) {
+                proven = NodeState::Draw;
+            } else if (state != NodeState::Loss) {
+                settled = false;
             }
-            res = bestUCT(node);
-            node = res.second;
         }
-        return res.second;
+        if (settled) {
+            Tree::store(tree.state[node], proven);
+        }
+        return settled;
     }
 
-    Move playoutPolicy(MonteCarloNode<S_ROWS, S_COLS>* node) {
-        auto moves{generateValidPositions(node->getBoard())};
-        int idx = rand() % moves.size() + 0;
+    // Mean result of the playouts in which the player moving into `node`
+    // filled its cell at any point, 0 without any.
+    float amafMean(MonteCarloTree<S_ROWS, S_COLS>& tree, uint32_t node) {
+        using Tree = MonteCarloTree<S_ROWS, S_COLS>;
+        int32_t visits{Tree::load(tree.raveVisits[node])};
+        int32_t wins{Tree::load(tree.raveWins[node])};
+        return visits ? static_cast<float>(wins) / visits : 0.0f;
+    }
 
-        return {moves[idx], node->getTurn()};
+    // All moves as first: every child of a node on the path whose cell the
+    // player to move there went on to fill, in the tree or in the playout,
+    // is credited with the playout as if it had been played first. `end` is
+    // the final position of the playout.
+    template <bool t_shared>
+    void updateRave(MonteCarloTree<S_ROWS, S_COLS>& tree,
+                    const std::vector<uint32_t>& path,
+                    BitBoard<S_ROWS, S_COLS> board,
+                    const BitBoard<S_ROWS, S_COLS>& end, long playoutResult) {
+        using Tree = MonteCarloTree<S_ROWS, S_COLS>;
+        using Bits = BitBoard<S_ROWS, S_COLS>;
+        Tile turn{tree.rootTurn()};
+        int32_t result{
+            static_cast<int32_t>(playoutResult * static_cast<int>(turn))};
+
+        for (size_t i{0}; i < path.size(); ++i) {
+            uint32_t position{tree.target(path[i])};
+            uint32_t first{Tree::load(tree.firstChild[position],
+                                      std::memory_order_acquire)};
+            uint32_t count{Tree::load(tree.childCount[position])};
+            uint64_t filled{end.stones[Bits::side(turn)] & board.playable()};
+            for (uint32_t child{first}; first != 0 && child < first + count;
+                 ++child) {
+                if (!(filled & Bits::columnMask(tree.column[child]))) {
+                    continue;
+                }
+                if constexpr (t_shared) {
+                    Tree::add(tree.raveVisits[child], 1);
+                    Tree::add(tree.raveWins[child], result);
+                } else {
+                    ++tree.raveVisits[child];
+                    tree.raveWins[child] += result;
+                }
+            }
+
+            if (i + 1 < path.size()) {
+                board.play(tree.column[path[i + 1]], turn);
+                turn = getEnemyTile(turn);
+                result = -result;
+            }
+        }
     }
 
-    std::optional<long> playout(MonteCarloNode<S_ROWS, S_COLS>* node) {
-        if (node->isTerminal()) {
-            return node->getWinState();
+    // The node two plies below the root whose position is `board`, that is
+    // one of our moves followed by the opponent's reply.
+    std::optional<uint32_t> findReply(
+        const MonteCarloTree<S_ROWS, S_COLS>& tree,
+        const Board<S_ROWS, S_COLS>& board) {
+        if (tree.size() == 0) {
+            return {};
         }
 
-        MonteCarloNode<S_ROWS, S_COLS>* simNode{new MonteCarloNode(*node)};
-        while (!simNode->isTerminal()) {
-            Move move{playoutPolicy(simNode)};
-            if (!simNode->applyMove(move)) {
-                throw std::exception();
+        const TreeCursor<S_ROWS, S_COLS> rootCursor(tree.rootBoard(),
+                                                    tree.rootTurn());
+        uint32_t first{tree.firstChild[tree.root]};
+        for (uint32_t ours{first}; ours < first + tree.childCount[tree.root];
+             ++ours) {
+            TreeCursor<S_ROWS, S_COLS> afterOurs{rootCursor};
+            afterOurs.play(tree.column[ours]);
+
+            uint32_t firstReply{tree.firstChild[ours]};
+            for (uint32_t reply{firstReply};
+                 reply < firstReply + tree.childCount[ours]; ++reply) {
+                TreeCursor<S_ROWS, S_COLS> afterReply{afterOurs};
+                afterReply.play(tree.column[reply]);
+                if (afterReply.board == BitBoard<S_ROWS, S_COLS>(board)) {
+                    return reply;
+                }
             }
         }
-        std::optional<long> res{simNode->getWinState()};
+        return {};
+    }
 
-        delete simNode;
-        return res;
+    // Makes the worker's tree start from `board`, keeping the subtree of the
+    // position the game actually reached; whatever else the previous search
+    // built is dropped.
+    void prepareTree(MonteCarloWorker<S_ROWS, S_COLS>& worker,
+                     const Board<S_ROWS, S_COLS>& board) {
+        MonteCarloTree<S_ROWS, S_COLS>& tree{worker.tree};
+        std::optional<uint32_t> reply{findReply(tree, board)};
+        // A proven reply keeps its subtree too, the search then stops at once;
+        // one settled by a probe has no children to pick from and starts
+        // afresh. So does a DAG, its subtrees reach outside themselves, and
+        // sequential halving, which needs its moves to start out even.
+        if (m_transpositions == 0 && !m_sequentialHalving && reply &&
+            (tree.state[reply.value()] == NodeState::Open ||
+             tree.firstChild[reply.value()] != 0)) {
+            worker.spareTree.copySubtree(tree, reply.value(), board, m_tile);
+            std::swap(tree, worker.spareTree);
+        } else {
+            tree.reset(board, m_tile);
+        }
     }
 
-    void backpropagate(MonteCarloNode<S_ROWS, S_COLS>* root,
-                       long playoutResults) {
-        MonteCarloNode<S_ROWS, S_COLS>* node{root};
+    // Whether the search is over: the deadline has passed, or the runner-up
+    // at the root could not catch the leader even if it got every playout
+    // left. With a deadline, what is left is extrapolated from the rate so
+    // far, once enough of this search has run to measure it.
+    bool budgetSpent(MonteCarloTree<S_ROWS, S_COLS>& tree,
+                     SearchBudget& budget) {
+        using Tree = MonteCarloTree<S_ROWS, S_COLS>;
+        if (budget.stop.load(std::memory_order_relaxed)) {
+            return true;
+        }
 
-        while (!(node->getParent() == nullptr)) {
-            node->wins += (playoutResults * static_cast<int>(m_tile));
-            node->visits++;
-            node = node->getParent();
+        int claimed{budget.claimed.load(std::memory_order_relaxed)};
+        double remaining{static_cast<double>(budget.simulations - claimed)};
+        if (budget.deadline) {
+            SearchBudget::Clock::time_point now{SearchBudget::Clock::now()};
+            if (now >= *budget.deadline) {
+                budget.stop = true;
+                return true;
+            }
+            std::chrono::duration<double> left{*budget.deadline - now};
+            std::chrono::duration<double> spent{now - budget.start};
+            // The rate of the first few playouts says nothing yet, and a
+            // reused tree already has a leader, so no early stop before it
+            // is known.
+            if (claimed < minPlayoutsForRate ||
+                spent < (*budget.deadline - budget.start) / 10) {
+                return false;
+            }
+            remaining = std::min(remaining, claimed * left / spent);
         }
 
-        // Again to update root node
-        node->wins += (playoutResults * static_cast<int>(m_tile));
-        node->visits++;
+        if (budget.stopWhenSettled) {
+            int32_t leader{0};
+            int32_t runnerUp{0};
+            uint32_t first{Tree::load(tree.firstChild[tree.root],
+                                      std::memory_order_acquire)};
+            uint32_t count{Tree::load(tree.childCount[tree.root])};
+            for (uint32_t child{first}; child < first + count; ++child) {
+                // Never played, whatever its count.
+                if (Tree::load(tree.state[child]) == NodeState::Loss) {
+                    continue;
+                }
+                int32_t visits{Tree::load(tree.visits[child])};
+                if (visits > leader) {
+                    runnerUp = leader;
+                    leader = visits;
+                } else if (visits > runnerUp) {
+                    runnerUp = visits;
+                }
+            }
+            if (runnerUp + remaining < leader) {
+                budget.stop = true;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <bool t_shared>
+    void search(MonteCarloTree<S_ROWS, S_COLS>& tree,
+                MonteCarloWorker<S_ROWS, S_COLS>& worker,
+                SearchBudget& budget) {
+        using Tree = MonteCarloTree<S_ROWS, S_COLS>;
+        const TreeCursor<S_ROWS, S_COLS> rootCursor(tree.rootBoard(),
+                                                    tree.rootTurn());
+
+        std::vector<uint32_t> path;
+        path.reserve(S_ROWS * S_COLS + 1);
+
+        for (int iteration{0};; ++iteration) {
+            // Nothing left to search once the root is proven.
+            if (Tree::load(tree.state[tree.root]) != NodeState::Open) {
+                break;
+            }
+            if (iteration % budgetCheckInterval == 0
+                    ? budgetSpent(tree, budget)
+                    : budget.stop.load(std::memory_order_relaxed)) {
+                break;
+            }
+            int claimed{budget.claimed.fetch_add(leafBatch(),
+                                                 std::memory_order_relaxed)};
+            if (claimed >= budget.simulations) {
+                break;
+            }
+
+            simulate<t_shared>(
+                tree, worker, rootCursor, path,
+                std::min(leafBatch(), budget.simulations - claimed));
+        }
+    }
+
+    // One iteration: down the tree, a playout or a batch of them from the
+    // leaf, and back up.
+    template <bool t_shared>
+    void simulate(MonteCarloTree<S_ROWS, S_COLS>& tree,
+                  MonteCarloWorker<S_ROWS, S_COLS>& worker,
+                  const TreeCursor<S_ROWS, S_COLS>& rootCursor,
+                  std::vector<uint32_t>& path, int batch,
+                  std::optional<uint32_t> rootChild = {}) {
+        // A full tree drops the children of its least visited nodes to
+        // make room. Shared trees and DAGs can't be rebuilt under their
+        // users, they just stop growing.
+        if (!t_shared && m_transpositions == 0 && !tree.hasRoom(1 + S_COLS)) {
+            worker.spareTree.copyPruned(tree, tree.nodeLimit() / 2,
+                                        worker.pruneOrder);
+            std::swap(tree, worker.spareTree);
+            ++worker.prunes;
+        }
+
+        TreeCursor<S_ROWS, S_COLS> cursor{rootCursor};
+        path.clear();
+
+        uint32_t leaf{traverse<t_shared>(tree, cursor, path, rootChild)};
+        // Only single playouts know their final position for RAVE.
+        if (m_raveEquivalence > 0 && batch == 1) {
+            BitBoard<S_ROWS, S_COLS> end;
+            long result{playout(tree, leaf, cursor, worker.rng, &end)};
+            backpropagate<t_shared>(tree, path, result, 1);
+            updateRave<t_shared>(tree, path, rootCursor.board, end, result);
+            return;
+        }
+        long results{playoutBatch(tree, leaf, cursor, worker, batch)};
+        backpropagate<t_shared>(tree, path, results, batch);
+    }
+
+    // Sequential halving over the root's children: the budget is split into
+    // one round per halving, each round gives every remaining move the same
+    // number of simulations, and the better half by mean result goes on to
+    // the next. The last move standing ends up with the most visits. Below
+    // the root the search is the usual UCT.
+    void searchHalving(MonteCarloTree<S_ROWS, S_COLS>& tree,
+                       MonteCarloWorker<S_ROWS, S_COLS>& worker,
+                       SearchBudget& budget) {
+        const TreeCursor<S_ROWS, S_COLS> rootCursor(tree.rootBoard(),
+                                                    tree.rootTurn());
+        if (tree.firstChild[tree.root] == 0 &&
+            !expand<false>(tree, tree.root, rootCursor)) {
+            return;
+        }
+
+        // Moves by their place among the root's children, which pruning
+        // keeps.
+        auto child{[&](uint32_t arm) {
+            return tree.firstChild[tree.root] + arm;
+        }};
+        auto score{[&](uint32_t arm) {
+            uint32_t node{tree.target(child(arm))};
+            if (tree.state[node] == NodeState::Win ||
+                tree.state[node] == NodeState::Loss) {
+                return tree.state[node] == NodeState::Win
+                           ? std::numeric_limits<float>::max()
+                           : -std::numeric_limits<float>::max();
+            }
+            return tree.visits[node] ? static_cast<float>(tree.wins[node]) /
+                                           tree.visits[node]
+                                     : 0.0f;
+        }};
+
+        // Moves that lose on the spot don't get a share: with an opponent's
+        // win playable only blocking it counts, and never play right below
+        // one.
+        using Bits = BitBoard<S_ROWS, S_COLS>;
+        const Bits& board{rootCursor.board};
+        uint64_t moves{board.playable()};
+        uint64_t losing{Bits::winningCells(
+            board.stones[Bits::side(getEnemyTile(rootCursor.turn))],
+            board.mask)};
+        uint64_t candidates{moves & losing ? moves & losing
+                                           : moves & ~(losing >> 1)};
+        std::vector<uint32_t> arms;
+        for (uint32_t arm{0}; arm < tree.childCount[tree.root]; ++arm) {
+            if (candidates & Bits::columnMask(tree.column[child(arm)])) {
+                arms.push_back(arm);
+            }
+        }
+        if (arms.empty()) {
+            arms.resize(tree.childCount[tree.root]);
+            std::iota(arms.begin(), arms.end(), 0);
+        }
+        std::vector<uint32_t> path;
+        path.reserve(S_ROWS * S_COLS + 1);
+
+        int iteration{0};
+        auto stopped{[&] {
+            return tree.state[tree.root] != NodeState::Open ||
+                   (iteration++ % budgetCheckInterval == 0
+                        ? budgetSpent(tree, budget)
+                        : budget.stop.load(std::memory_order_relaxed));
+        }};
+
+        const int rounds{static_cast<int>(std::bit_width(arms.size() - 1))};
+        for (int round{0}; arms.size() > 1; ++round) {
+            int left{budget.simulations -
+                     budget.claimed.load(std::memory_order_relaxed)};
+            int share{std::max(leafBatch(),
+                               left / static_cast<int>(arms.size() *
+                                                       (rounds - round)))};
+            for (uint32_t arm : arms) {
+                for (int done{0}; done < share; done += leafBatch()) {
+                    if (settled(tree, tree.target(child(arm)))) {
+                        break;
+                    }
+                    if (stopped()) {
+                        return;
+                    }
+                    int claimed{budget.claimed.fetch_add(
+                        leafBatch(), std::memory_order_relaxed)};
+                    if (claimed >= budget.simulations) {
+                        return;
+                    }
+                    simulate<false>(tree, worker, rootCursor, path,
+                                    std::min(leafBatch(),
+                                             budget.simulations - claimed),
+                                    arm);
+                }
+            }
+
+            std::stable_sort(arms.begin(), arms.end(),
+                             [&](uint32_t a, uint32_t b) {
+                                 return score(a) > score(b);
+                             });
+            arms.resize((arms.size() + 1) / 2);
+        }
+
+        // Rounding leftovers, if any, go to the move chosen.
+        while (!arms.empty() && !settled(tree, tree.target(child(arms[0]))) &&
+               !stopped()) {
+            int claimed{budget.claimed.fetch_add(leafBatch(),
+                                                 std::memory_order_relaxed)};
+            if (claimed >= budget.simulations) {
+                break;
+            }
+            simulate<false>(tree, worker, rootCursor, path,
+                            std::min(leafBatch(), budget.simulations - claimed),
+                            arms[0]);
+        }
+    }
+
+    // Searches a tree only this worker's thread uses.
+    void searchTree(MonteCarloWorker<S_ROWS, S_COLS>& worker,
+                    SearchBudget& budget) {
+        if (m_sequentialHalving) {
+            searchHalving(worker.tree, worker, budget);
+        } else {
+            search<false>(worker.tree, worker, budget);
+        }
+    }
+
+    // The only legal move, or a move that wins on the spot, if there is one.
+    std::optional<int> obviousColumn(const Board<S_ROWS, S_COLS>& board) const {
+        using Bits = BitBoard<S_ROWS, S_COLS>;
+        const Bits bits(board);
+        uint64_t moves{bits.playable()};
+        if (std::popcount(moves) == 1) {
+            return std::countr_zero(moves) / Bits::height;
+        }
+        for (int column{0}; column < static_cast<int>(S_COLS); ++column) {
+            if (!bits.canPlay(column)) {
+                continue;
+            }
+            Bits after{bits};
+            after.play(column, m_tile);
+            if (Bits::hasWon(after.stones[Bits::side(m_tile)])) {
+                return column;
+            }
+        }
+        return {};
     }
 
     Move monteCarloTreeSearch(Board<S_ROWS, S_COLS>& board) {
-        MonteCarloNode<S_ROWS, S_COLS>* root{new MonteCarloNode(m_tile, board)};
+        if (std::optional<int> column{obviousColumn(board)}) {
+            const BitBoard<S_ROWS, S_COLS> bits(board);
+            return {{column.value(), bits.landingRow(column.value())}, m_tile};
+        }
 
-        MonteCarloNode<S_ROWS, S_COLS>* leaf;
+        // Root parallel trees each get their own budget, the other modes
+        // share the first.
+        const bool rootParallel{m_nThreads > 1 &&
+                                m_parallelism == Parallelism::Root};
+        std::vector<SearchBudget> budgets(rootParallel ? m_nThreads : 1);
+        for (auto& worker : m_workers) {
+            worker.prunes = 0;
+        }
+        for (int i{0}; i < static_cast<int>(budgets.size()); ++i) {
+            budgets[i].simulations =
+                rootParallel ? simulationsFor(i) : m_nSimulation;
+            budgets[i].stopWhenSettled =
+                m_earlyStop && !rootParallel && !m_sequentialHalving;
+        }
+        // The clock starts once the tree is ready to search.
+        auto startClock = [this](SearchBudget& budget) {
+            budget.start = SearchBudget::Clock::now();
+            if (m_timeBudget.count() > 0) {
+                budget.deadline = budget.start + m_timeBudget;
+            }
+        };
 
-        for (int i{0}; i < m_nSimulation; ++i) {
-            leaf = traverse(root);
-            auto results{playout(leaf)};
-            backpropagate(leaf, results.value());
+        std::vector<std::thread> threads;
+        if (m_parallelism == Parallelism::Leaf && m_nThreads > 1) {
+            if (!m_pool) {
+                m_pool = std::make_unique<ThreadPool>(m_nThreads);
+            }
+            prepareTree(m_workers[0], board);
+            startClock(budgets[0]);
+            searchTree(m_workers[0], budgets[0]);
+        } else if (m_parallelism == Parallelism::Tree && m_nThreads > 1) {
+            // Every iteration adds at most one block of children, and the
+            // arrays must not move while the threads are running. Once the
+            // room reserved is used up, the tree stops growing.
+            MonteCarloTree<S_ROWS, S_COLS>& tree{m_workers[0].tree};
+            prepareTree(m_workers[0], board);
+            const size_t nodes{static_cast<size_t>(m_nSimulation) * S_COLS + 1};
+            const size_t room{tree.nodeLimit() > 0 ? tree.nodeLimit()
+                                                   : sharedTreeNodes};
+            tree.reserve(tree.size() + std::min(nodes, room));
+            startClock(budgets[0]);
+
+            for (int i{1}; i < m_nThreads; ++i) {
+                threads.emplace_back([this, &tree, &budgets, i] {
+                    search<true>(tree, m_workers[i], budgets[0]);
+                });
+            }
+            search<true>(tree, m_workers[0], budgets[0]);
+        } else {
+            for (int i{1}; i < m_nThreads; ++i) {
+                threads.emplace_back([this, &board, &budgets, &startClock, i] {
+                    prepareTree(m_workers[i], board);
+                    startClock(budgets[i]);
+                    searchTree(m_workers[i], budgets[i]);
+                });
+            }
+            prepareTree(m_workers[0], board);
+            startClock(budgets[0]);
+            searchTree(m_workers[0], budgets[0]);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        m_pool.reset();
+
+        std::array<long, S_COLS> visits{};
+        std::array<long, S_COLS> wins{};
+        std::array<NodeState, S_COLS> proven{};
+        for (const auto& worker : m_workers) {
+            const MonteCarloTree<S_ROWS, S_COLS>& tree{worker.tree};
+            // Trees of a root that has since been left, or unused ones of
+            // other threads in tree parallel mode.
+            if (tree.size() == 0 || !(tree.rootBoard() == board)) {
+                continue;
+            }
+            uint32_t first{tree.firstChild[tree.root]};
+            for (uint32_t child{first};
+                 child < first + tree.childCount[tree.root]; ++child) {
+                visits[tree.column[child]] += tree.visits[child];
+                wins[tree.column[child]] += tree.wins[child];
+                if (tree.state[child] == NodeState::Win ||
+                    tree.state[child] == NodeState::Loss) {
+                    proven[tree.column[child]] = tree.state[child];
+                }
+            }
         }
 
-        std::vector<Move> allMoves{root->getExpandedMoves()};
+        // A proven win beats any visit count, and a proven loss is only
+        // played when every move loses.
+        const TreeCursor<S_ROWS, S_COLS> rootCursor(board, m_tile);
+        bool allLost{true};
+        for (int column{0}; column < static_cast<int>(S_COLS); ++column) {
+            if (rootCursor.board.canPlay(column) &&
+                proven[column] != NodeState::Loss) {
+                allLost = false;
+            }
+        }
+        // Equal visits, as sequential halving leaves its last moves, go to
+        // the better result.
         Move res{};
-        int maxVisits{0};
-        for (auto move : allMoves) {
-            MonteCarloNode<S_ROWS, S_COLS>* child{
-                root->getChildForMove(move).value()};
-            if (child->visits > maxVisits) {
-                maxVisits = child->visits;
-                res = move;
+        long maxVisits{-1};
+        long maxWins{std::numeric_limits<long>::min()};
+        for (int column{0}; column < static_cast<int>(S_COLS); ++column) {
+            if (!rootCursor.board.canPlay(column)) {
+                continue;
+            }
+            if (proven[column] == NodeState::Win) {
+                return {{column, rootCursor.board.landingRow(column)}, m_tile};
+            }
+            if (proven[column] == NodeState::Loss && !allLost) {
+                continue;
+            }
+            if (visits[column] > maxVisits ||
+                (visits[column] == maxVisits && wins[column] > maxWins)) {
+                maxVisits = visits[column];
+                maxWins = wins[column];
+                res = {{column, rootCursor.board.landingRow(column)}, m_tile};
+            }
+        }
+        // No move left has a visit: the time ran out before the first
+        // playout, or sequential halving proved all its moves lost. The
+        // column nearest the centre is the best guess without a search.
+        if (maxVisits <= 0) {
+            for (int offset{0}; offset < static_cast<int>(S_COLS); ++offset) {
+                int column{static_cast<int>(S_COLS) / 2 +
+                           (offset % 2 ? -(offset + 1) / 2 : offset / 2)};
+                if (column >= 0 && column < static_cast<int>(S_COLS) &&
+                    rootCursor.board.canPlay(column) &&
+                    (proven[column] != NodeState::Loss || allLost)) {
+                    return {{column, rootCursor.board.landingRow(column)},
+                            m_tile};
+                }
             }
         }
-        delete root;
         return res;
     }
 
@@ -380,10 +1832,116 @@ class MonteCarloPlayer : public Player<S_ROWS, S_COLS> {
     }
 
    private:
-    int m_c;
+    // Visits a thread counts on a node it is still searching below, as if the
+    // playout had been lost.
+    static constexpr int32_t virtualLoss{1};
+    // Iterations between looks at the clock and the root visit counts.
+    static constexpr int budgetCheckInterval{16};
+    // Playouts of a search before its rate is extrapolated to the deadline.
+    static constexpr int minPlayoutsForRate{256};
+    // Most nodes reserved for a tree the threads share when no memory limit
+    // sets them.
+    static constexpr size_t sharedTreeNodes{size_t{1} << 22};
+
+    // sqrt(log(n)) for the exploration term, from a table while n is small,
+    // which in most nodes it is.
+    static float sqrtLog(int32_t n) {
+        static const std::array<float, 4096> table{[] {
+            std::array<float, 4096> res{};
+            for (size_t i{1}; i < res.size(); ++i) {
+                res[i] = std::sqrt(std::log(static_cast<float>(i)));
+            }
+            return res;
+        }()};
+        return n < static_cast<int32_t>(table.size())
+                   ? table[std::max(n, 0)]
+                   : std::sqrt(std::log(static_cast<float>(n)));
+    }
+
+    // 1 / sqrt(x) to about 0.2%, plenty for ranking UCT values: the classic
+    // bit trick and one Newton step, a few multiplies instead of a square
+    // root and a division.
+    static float fastRsqrt(float x) {
+        float y{std::bit_cast<float>(0x5f375a86u -
+                                     (std::bit_cast<uint32_t>(x) >> 1))};
+        return y * (1.5f - 0.5f * x * y * y);
+    }
+
+    void addVirtualLoss(MonteCarloTree<S_ROWS, S_COLS>& tree, uint32_t node) {
+        MonteCarloTree<S_ROWS, S_COLS>::add(tree.visits[node], virtualLoss);
+        if (node != tree.root) {
+            MonteCarloTree<S_ROWS, S_COLS>::add(tree.wins[node], -virtualLoss);
+        }
+    }
+
+    // Playouts per leaf, see setLeafBatch().
+    int leafBatch() const {
+        if (m_leafBatch > 0) {
+            return m_leafBatch;
+        }
+        return m_parallelism == Parallelism::Leaf ? m_nThreads : 1;
+    }
+
+    // Splits m_memoryLimit into node limits, see setMemoryLimit().
+    void applyMemoryLimit() {
+        using Tree = MonteCarloTree<S_ROWS, S_COLS>;
+        const size_t searching{
+            m_parallelism == Parallelism::Root ? m_workers.size() : 1};
+        // Only trees no other thread uses are pruned, and not DAGs.
+        const bool prunes{m_memoryLimit > 0 && m_transpositions == 0 &&
+                          !(m_parallelism == Parallelism::Tree &&
+                            m_nThreads > 1)};
+        size_t nodes{0};
+        if (m_memoryLimit > 0) {
+            size_t tables{m_workers.size() * m_transpositions *
+                          Tree::tableEntryBytes()};
+            size_t perWorker{m_memoryLimit > tables
+                                 ? (m_memoryLimit - tables) / searching
+                                 : 0};
+            size_t perNode{2 * m_workers[0].tree.bytesPerNode() +
+                           (prunes ? sizeof(uint32_t) : 0)};
+            // Room for the root and its children at the very least.
+            nodes = std::max<size_t>(perWorker / perNode, 2 * (1 + S_COLS));
+        }
+        for (size_t i{0}; i < m_workers.size(); ++i) {
+            m_workers[i].tree.setNodeLimit(nodes);
+            m_workers[i].spareTree.setNodeLimit(nodes);
+            std::vector<uint32_t> pruneOrder;
+            if (prunes && i < searching) {
+                pruneOrder.reserve(nodes);
+            }
+            m_workers[i].pruneOrder.swap(pruneOrder);
+        }
+    }
+
+    int simulationsFor(int worker) const {
+        return m_nSimulation / m_nThreads +
+               (worker < m_nSimulation % m_nThreads);
+    }
+
+    float m_c;
     int m_nSimulation;
+    int m_nThreads;
     Tile m_tile;
     std::string m_name;
+    Parallelism m_parallelism;
+    // 0 until setLeafBatch() is called, see leafBatch().
+    int m_leafBatch;
+    std::chrono::milliseconds m_timeBudget;
+    bool m_earlyStop;
+    RolloutPolicy m_policy;
+    float m_raveEquivalence;
+    size_t m_transpositions;
+    int m_probeDepth;
+    int32_t m_probeAfter;
+    bool m_expandTerminals;
+    bool m_sequentialHalving;
+    size_t m_memoryLimit;
+
+    // Trees are kept between moves.
+    std::vector<MonteCarloWorker<S_ROWS, S_COLS>> m_workers;
+    // Only alive during a leaf parallel search.
+    std::unique_ptr<ThreadPool> m_pool;
 };
 
 }  // namespace ConnectN
@@ -396,11 +1954,11 @@ void playTwoPlayers(ConnectN::Player<S_ROWS, S_COLS>* playerPositive,
 }
 
 template <size_t S_ROWS, size_t S_COLS>
-void humanVsMonteCarlo(int simulations, int c) {
+void humanVsMonteCarlo(int simulations, float c, int threads) {
     ConnectN::HumanPlayer<S_ROWS, S_COLS> playerHuman("Human",
                                                       ConnectN::Tile::Positive);
     ConnectN::MonteCarloPlayer<S_ROWS, S_COLS> playerMonteCarlo(
-        simulations, c, "Mr. Monte Carlo", ConnectN::Tile::Negative);
+        simulations, c, threads, "Mr. Monte Carlo", ConnectN::Tile::Negative);
 
     playTwoPlayers(&playerHuman, &playerMonteCarlo);
 }
@@ -415,12 +1973,12 @@ void humanVsMinimax(int depth) {
     playTwoPlayers(&playerHuman, &playerMinimax);
 }
 template <size_t S_ROWS, size_t S_COLS>
-void minimaxVsMonteCarlo(int depth, int simulations, float c) {
+void minimaxVsMonteCarlo(int depth, int simulations, float c, int threads) {
     ConnectN::MinimaxPlayer<S_ROWS, S_COLS> playerMinimax(
         depth, "Mrs. Minimax", ConnectN::Tile::Positive,
         ConnectN::Tile::Negative);
     ConnectN::MonteCarloPlayer<S_ROWS, S_COLS> playerMonteCarlo(
-        simulations, c, "Mr. Monte Carlo", ConnectN::Tile::Negative);
+        simulations, c, threads, "Mr. Monte Carlo", ConnectN::Tile::Negative);
 
     playTwoPlayers(&playerMinimax, &playerMonteCarlo);
 }
@@ -437,23 +1995,80 @@ void minimaxVsMinimax(int depthA, int depthB) {
     playTwoPlayers(&playerMinimaxA, &playerMinimaxB);
 }
 
+// Random playouts per second from the empty board, through the Board based
+// loop (move list + evaluate() per move), through the bitboard kernel the
+// Monte Carlo player uses for single playouts, and through the SIMD lanes it
+// uses for batches (of 64 here).
+template <size_t S_ROWS, size_t S_COLS>
+void benchmarkRollouts(int rollouts) {
+    using Clock = std::chrono::steady_clock;
+    ConnectN::Random rng(1);
+    const ConnectN::Board<S_ROWS, S_COLS> empty;
+
+    long checksum{0};
+    Clock::time_point start{Clock::now()};
+    for (int i{0}; i < rollouts; ++i) {
+        ConnectN::Board<S_ROWS, S_COLS> board{empty};
+        ConnectN::Tile turn{ConnectN::Tile::Positive};
+        while (true) {
+            auto moves{ConnectN::generateValidPositions(board)};
+            ConnectN::Vec2i pos{moves[rng.below(moves.size())]};
+            board << ConnectN::Move{pos, turn};
+            std::optional<long> res{ConnectN::evaluate(board, pos).first};
+            if (res) {
+                checksum += res.value();
+                break;
+            }
+            turn = ConnectN::getEnemyTile(turn);
+        }
+    }
+    std::chrono::duration<double> boardTime{Clock::now() - start};
+
+    start = Clock::now();
+    const ConnectN::BitBoard<S_ROWS, S_COLS> emptyBits(empty);
+    for (int i{0}; i < rollouts; ++i) {
+        checksum += ConnectN::randomRollout(emptyBits, ConnectN::Tile::Positive,
+                                            rng);
+    }
+    std::chrono::duration<double> bitTime{Clock::now() - start};
+
+    start = Clock::now();
+    ConnectN::RolloutLanes<S_ROWS, S_COLS> lanes(1);
+    for (int done{0}; done < rollouts; done += 64) {
+        checksum += lanes.run(emptyBits, ConnectN::Tile::Positive,
+                              std::min(64, rollouts - done))
+                        .sum();
+    }
+    std::chrono::duration<double> laneTime{Clock::now() - start};
+
+    std::cout << "Board rollouts/s:    " << rollouts / boardTime.count()
+              << "\nBitBoard rollouts/s: " << rollouts / bitTime.count()
+              << "\nLanes (" << lanes.width
+              << ") rollouts/s: " << rollouts / laneTime.count()
+              << "\nSpeed-up: " << boardTime / bitTime << ", "
+              << boardTime / laneTime << " (" << checksum << ")\n";
+}
+
 int main() {
     constexpr int rows{6};
     constexpr int cols{7};
-    srand(time(0));
 
     // const float c{std::sqrt(2)};  // should be atleast std::sqrt(2)
     const float c{1.5};  // This seems to be the best apparently.
 
-    const int minimaxDepth{7};
+    const int minimaxDepth{11};
     const int monteCarloSimulations{150000};
+    const int monteCarloThreads{
+        static_cast<int>(std::max(1u, std::thread::hardware_concurrency()))};
 
-    // minimaxVsMinimax<rows, cols>(7, 7);  // 7 seems to be the max limit. We
-    // get dimishing returns after this.
+    // minimaxVsMinimax<rows, cols>(11, 11);  // About half a second per game.
+    // Every ply deeper costs two to three times as much.
 
-    // minimaxVsMonteCarlo<rows, cols>(minimaxDepth, monteCarloSimulations, c);
-    humanVsMonteCarlo<rows, cols>(monteCarloSimulations, c);
+    // minimaxVsMonteCarlo<rows, cols>(minimaxDepth, monteCarloSimulations, c,
+    //                                 monteCarloThreads);
+    humanVsMonteCarlo<rows, cols>(monteCarloSimulations, c, monteCarloThreads);
     // humanVsMinimax<rows, cols>(minimaxDepth);
+    // benchmarkRollouts<rows, cols>(1000000);
 
     return 0;
 }
\ No newline at end of file